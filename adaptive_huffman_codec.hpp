@@ -3,17 +3,58 @@
 
 #include "type.hpp"
 #include "bit_math.hpp"
+#include "symbol_index.hpp"
+#include "codec.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <cstddef>
+#include <limits>
+#include <map>
 #include <utility>
 #include <memory>
 #include <ostream>
+#include <vector>
 
 #include <cctype>
 
-template<typename symbol_type = char>
+template<typename tree_type, Size lookup_bit>
+class AdaptiveHuffmanLookup;
+
+// The n-th Fibonacci number, F(1) = F(2) = 1
+constexpr Size fibonacci(Size n, Size a = 0, Size b = 1) {
+	return n == 0 ? a : fibonacci(n - 1, b, a + b);
+}
+
+// Deepest code of a tree whose root weight stays below limit: a tree of total weight w is
+// at most d deep for the largest d with F(d + 1) <= w, the zero weight NYT node accounts for the + 1
+constexpr Size rescaled_code_length(Size limit, Size depth = 0) {
+	return fibonacci(depth + 2) < limit ? rescaled_code_length(limit, depth + 1) : depth;
+}
+
+// Largest rescale bit whose trees give codes of at most max_code_length bits
+constexpr Size code_length_rescale_bit(Size max_code_length, Size bit = 0) {
+	return (static_cast<Size>(1) << (bit + 1)) <= fibonacci(max_code_length + 2) ? code_length_rescale_bit(max_code_length, bit + 1) : bit;
+}
+
+// Shortest code length cap for symbols of symbol_bit bits: its rescale bit has to exceed them, see AdaptiveHuffmanTree
+constexpr Size min_code_length(Size symbol_bit, Size max_code_length = 1) {
+	return code_length_rescale_bit(max_code_length) > symbol_bit ? max_code_length : min_code_length(symbol_bit, max_code_length + 1);
+}
+
+// Rescale bit of a code length cap, checked against the shortest cap that symbol_bit allows
+template<Size symbol_bit, Size max_code_length>
+struct CodeLengthLimit {
+	static_assert(max_code_length >= min_code_length(symbol_bit),
+		"max_code_length is below min_code_length(symbol bits): at least 13 for 8-bit symbols, 25 for 16-bit, 48 for 32-bit");
+
+	static Size const RESCALE_BIT = code_length_rescale_bit(max_code_length);
+};
+
+// With a nonzero rescale_bit, all weights are halved whenever the root weight reaches 1 << rescale_bit,
+// so that the tree keeps following the input, and its depth stays bounded
+template<typename symbol_type = char, Size rescale_bit = 0, template<typename, Size> class location_template = SymbolIndex>
 class AdaptiveHuffmanTree {
 private:
 	using Self = AdaptiveHuffmanTree;
@@ -22,6 +63,23 @@ public:
 	using Symbol = symbol_type;
 	using InternalSymbol = UInt64;
 
+	static Size const SYMBOL_BIT = BitSize<Symbol>::value;
+	static Size const SYMBOL_NUM = 1ULL << SYMBOL_BIT;
+	static InternalSymbol const NYT_SYMBOL = SYMBOL_NUM; // id of not yet transmitted
+	static InternalSymbol const RUN_SYMBOL = SYMBOL_NUM + 1; // id of the run escape, a leaf only for coders that add it
+	static InternalSymbol const INTERNAL = SYMBOL_NUM + 2; // id of internal node
+	static Size const NODE_NUM = 2 * SYMBOL_NUM + 4; // capacity of node array, slot 0 is null
+
+	static Size const RESCALE_BIT = rescale_bit;
+	static Size const RESCALE_LIMIT = RESCALE_BIT != 0 ? static_cast<Size>(1) << RESCALE_BIT : 0;
+
+	// Halving leaves every leaf at weight one at least, so the limit must clear the alphabet by a margin
+	// for a rescale to free room for the next; above twice the alphabet, rescales cost O(1) per symbol
+	static_assert(RESCALE_BIT == 0 || RESCALE_BIT > SYMBOL_BIT, "rescale_bit must exceed the symbol bits");
+
+	// Longest code the tree can give, NYT and the run escape included
+	static Size const MAX_CODE_LENGTH = RESCALE_LIMIT != 0 ? rescaled_code_length(RESCALE_LIMIT) : SYMBOL_NUM + 1;
+
 	static InternalSymbol to_internal(Symbol symbol) {
 		return static_cast<UInt64>(static_cast<typename Unsigned<Symbol>::Type>(symbol));
 	}
@@ -31,16 +89,23 @@ public:
 	}
 
 private:
-	struct Node;
+	// Nodes are kept in rank order, highest first, and link to each other by their slot
+	using Index = typename Conditional<(NODE_NUM <= 0x10000), UInt16, UInt32>::Type;
+
+	static Index const NIL = 0;
+	static Index const ROOT = 1;
 
-	using Linker = Node *;
+	// The array starts small and grows with the symbols seen, up to what Index can address
+	static Size const MAX_NODE_NUM = NODE_NUM < static_cast<Size>(std::numeric_limits<Index>::max()) ? NODE_NUM : static_cast<Size>(std::numeric_limits<Index>::max());
+	static Size const INITIAL_NODE_NUM = MAX_NODE_NUM < 1024 ? MAX_NODE_NUM : 1024;
+
+	using Location = location_template<Index, SYMBOL_BIT>;
 
 	struct Node {
 		InternalSymbol symbol;
 		Size weight;
-		Linker parent, left, right;
-		Linker next, prev; /* doubly-linked list */
-		Linker * block_head; /* highest ranked node in block */
+		Index parent, left, right;
+		Index block; /* run of slots of this weight */
 	};
 
 public:
@@ -49,31 +114,32 @@ public:
 		using Self = Cursor;
 
 	private:
-		Node const * node;
+		Node const * nodes;
+		Index index;
 
 	public:
-		Cursor(Node const * node) : node(node) {
+		Cursor(Node const * nodes, Index index) : nodes(nodes), index(index) {
 			// do nothing
 		}
 
 		InternalSymbol symbol() const {
-			return node->symbol;
+			return node().symbol;
 		}
 
 		bool is_null() const {
-			return node == nullptr;
+			return index == NIL;
 		}
 
 		bool is_root() const {
-			return node->parent == nullptr;
+			return node().parent == NIL;
 		}
 
 		bool is_left_child() const {
-			return node->parent->left == node;
+			return nodes[node().parent].left == index;
 		}
 
 		bool is_right_child() const {
-			return node->parent->right == node;
+			return nodes[node().parent].right == index;
 		}
 
 		Bit side() const {
@@ -86,66 +152,82 @@ public:
 		}
 
 		Self parent() const {
-			return Self(node->parent);
+			return Self(nodes, node().parent);
 		}
 
 		Self left() const {
-			return Self(node->left);
+			return Self(nodes, node().left);
 		}
 
 		Self right() const {
-			return Self(node->right);
+			return Self(nodes, node().right);
 		}
 		Self & up() {
-			node = node->parent;
+			index = node().parent;
 			return *this;
 		}
 
 		Self & down_left() {
-			node = node->left;
+			index = node().left;
 			return *this;
 		}
 
 		Self & down_right() {
-			node = node->right;
+			index = node().right;
 			return *this;
 		}
 
 		Self & down(Bit bit) {
 			return bit == Bit::zero ? down_left() : down_right();
 		}
-	}; // class Cursor
 
-public:
-	static Size const SYMBOL_BIT = BitSize<Symbol>::value;
-	static Size const SYMBOL_NUM = 1ULL << SYMBOL_BIT;
-	static InternalSymbol const NYT_SYMBOL = SYMBOL_NUM; // id of not yet transmitted
-	static InternalSymbol const INTERNAL = SYMBOL_NUM + 1; // id of internal node
+	private:
+		Node const & node() const {
+			return nodes[index];
+		}
+	}; // class Cursor
 
 private:
-	Linker * free_linkers;
-	Node * tree_root;
-	Linker list_head;
-	Linker location[SYMBOL_NUM + 1];
+	std::vector<Node> nodes; /* nodes[ROOT] is the root and nodes[node_top] is NYT, weights never rise in between */
+	std::vector<Index> leaders; /* first slot of each block, or the next free block */
+	Index node_top;
+	Index block_top;
+	Index free_blocks;
+	Location location;
+	std::vector<Index> * changes; /* slots whose content changed, while a lookup is attached */
+	std::vector<Node> leaves, internals; /* kept for rescale */
+
+	template<typename, Size>
+	friend class AdaptiveHuffmanLookup;
 
 public:
-	AdaptiveHuffmanTree() : free_linkers(nullptr) {
-		for (int i = 0; i <= SYMBOL_NUM; ++i) {
-			location[i] = nullptr;
-		}
-		tree_root = list_head = location[NYT_SYMBOL] = get_node(NYT_SYMBOL);
-		list_head->block_head = get_linker(list_head);
+	AdaptiveHuffmanTree() : nodes(INITIAL_NODE_NUM), leaders(INITIAL_NODE_NUM), node_top(NIL), changes(nullptr) {
+		reset();
 	}
 
-
-	virtual ~AdaptiveHuffmanTree();
+	// Forget every symbol, going back to the lone NYT node; costs as much as the nodes in use
+	void reset() {
+		for (Index index = ROOT; index <= node_top; ++index) {
+			if (nodes[index].symbol != INTERNAL) {
+				location.erase(nodes[index].symbol);
+			}
+		}
+		node_top = ROOT;
+		block_top = free_blocks = NIL;
+		nodes[ROOT] = Node{NYT_SYMBOL, 0, NIL, NIL, NIL, get_block(ROOT)};
+		location.set(NYT_SYMBOL, ROOT);
+		if (changes != nullptr) {
+			changes->clear();
+		}
+		touch(NIL);
+	}
 
 	Cursor root() const {
-		return Cursor(tree_root);
+		return Cursor(nodes.data(), ROOT);
 	}
 
 	Cursor operator[](InternalSymbol symbol) const {
-		return Cursor(location[symbol]);
+		return Cursor(nodes.data(), location[symbol]);
 	}
 
 	Cursor operator[](Symbol symbol) const {
@@ -157,71 +239,167 @@ public:
 	}
 
 	Self & operator<<(Symbol symbol) {
-		InternalSymbol internal_symbol = to_internal(symbol);
-		if (location[internal_symbol] == nullptr) {
-			new_symbol(internal_symbol);
+		return *this << to_internal(symbol);
+	}
+
+	// Start over from the given symbols and weights, all above zero, as if they had been counted;
+	// the tree takes the Huffman shape of the weights, which counting them one by one may not give
+	void prime(std::vector<std::pair<InternalSymbol, Size>> const & weights);
+
+	// Become a copy of other, reusing the storage held; a lookup watching this tree has to be reset first
+	void assign(Self const & other);
+
+	// A copy of the tree, for a coder to start from where this one stands
+	std::unique_ptr<Self> clone() const {
+		std::unique_ptr<Self> copy(new Self());
+		copy->assign(*this);
+		return copy;
+	}
+
+	// Write the tree as it stands, so that get gives back one that codes alike: the last slot (varint), then
+	// from the root on, for each internal node 0 and the pair its children fill (varint each), for each leaf
+	// its symbol plus one and its weight (varint each)
+	void put(typename IO<Byte>::OStream & ostream) const;
+
+	// Become the tree written by put, false and reset if the input is not one; a lookup watching this tree has to be reset first
+	bool get(typename IO<Byte>::IStream & istream);
+
+	// Count one more of a symbol, or of the run escape
+	Self & operator<<(InternalSymbol symbol) {
+		Index index = location[symbol];
+		if (index == NIL) {
+			index = new_symbol(symbol);
+		}
+		increse_weight(index);
+		if (RESCALE_LIMIT != 0 && nodes[ROOT].weight >= RESCALE_LIMIT) {
+			rescale();
 		}
-		increse_weight(location[internal_symbol]);
 		return *this;
 	}
 
 private:
-	void new_symbol(InternalSymbol symbol);
-
-	// Do the increments
-	void increse_weight(Node * node);
-
-	Node * get_node(InternalSymbol symbol) {
-		Node * node = new Node;
-		node->symbol = symbol;
-		node->weight = 0;
-		node->parent = node->left = node->right = nullptr;
-		node->block_head = nullptr;
-		node->next = node->prev = nullptr;
-		return node;
-	}
-
-	Linker * get_linker(Linker value) {
-		Linker * linker;
-		if (free_linkers != nullptr) {
-			linker = free_linkers;
-			free_linkers = reinterpret_cast<Linker *>(*linker);
-			*linker = value;
+	// Split the NYT node, returns the node of symbol
+	Index new_symbol(InternalSymbol symbol);
+
+	// Do the increments, from the node at index up to the root
+	void increse_weight(Index index);
+
+	// Halve the weights and rebuild the tree from them
+	void rescale();
+
+	// Fill the slots up to node_top from leaves, sorted by weight from the lightest, NYT first
+	void build();
+
+	// Give each run of equal weights a block
+	void link_blocks();
+
+	// Read the nodes for get, setting node_top to the last slot filled so far
+	bool get_nodes(typename IO<Byte>::IStream & istream);
+
+	// Exchange the nodes at two slots of one block, with their subtrees; the slots keep their place in the tree
+	void swap_nodes(Index index1, Index index2) {
+		Node & node1 = nodes[index1];
+		Node & node2 = nodes[index2];
+		assert(node1.block == node2.block && node1.symbol != NYT_SYMBOL && node2.symbol != NYT_SYMBOL);
+		std::swap(node1.symbol, node2.symbol);
+		std::swap(node1.left, node2.left);
+		std::swap(node1.right, node2.right);
+		relink(index1);
+		relink(index2);
+		touch(index1);
+		touch(index2);
+	}
+
+	// Move the leader of its block one weight up, into the block ahead if that has the new weight
+	void increment(Index index) {
+		Node & node = nodes[index];
+		assert(leaders[node.block] == index);
+		if (index < node_top && nodes[index + 1].block == node.block) {
+			++leaders[node.block];
+		} else {
+			leaders[node.block] = free_blocks;
+			free_blocks = node.block;
+		}
+		++node.weight;
+		if (index != ROOT && nodes[index - 1].weight == node.weight) {
+			node.block = nodes[index - 1].block;
 		} else {
-			linker = new Linker(value);
+			node.block = get_block(index);
 		}
-		return linker;
 	}
 
-	void put_linker(Linker * linker) {
-		*linker = reinterpret_cast<Linker>(free_linkers);
-		free_linkers = linker;
+	// Let the links into the node at index find it there
+	void relink(Index index) {
+		Node const & node = nodes[index];
+		if (node.symbol == INTERNAL) {
+			nodes[node.left].parent = nodes[node.right].parent = index;
+		} else {
+			location.set(node.symbol, index);
+		}
+	}
+
+	Index get_block(Index leader) {
+		Index block;
+		if (free_blocks != NIL) {
+			block = free_blocks;
+			free_blocks = leaders[block];
+		} else {
+			// Blocks are never empty, so they never outnumber nodes
+			assert(block_top < node_top);
+			block = ++block_top;
+		}
+		leaders[block] = leader;
+		return block;
+	}
+
+	// Tree shape as the lookup sees it
+	Index root_node() const {
+		return ROOT;
+	}
+
+	Index parent_node(Index index) const {
+		return nodes[index].parent;
+	}
+
+	Index child_node(Index index, Bit bit) const {
+		return bit == Bit::zero ? nodes[index].left : nodes[index].right;
+	}
+
+	Bit side_of(Index index) const {
+		return nodes[nodes[index].parent].left == index ? Bit::zero : Bit::one;
+	}
+
+	bool is_leaf(Index index) const {
+		return nodes[index].left == NIL;
 	}
 
-	void push_head(Node * node) {
-		node->next = list_head;
-		list_head->prev = node;
-		node->block_head = list_head->block_head;
-		list_head = node;
+	Cursor cursor(Index index) const {
+		return Cursor(nodes.data(), index);
 	}
 
-	// Swap the location of these two nodes in the tree
-	void swap_in_tree(Node * node1, Node * node2);
+	// Start or stop recording changes for a lookup; slots are not kept by depth, so all of them are recorded
+	void watch(std::vector<Index> * changes, Size) {
+		this->changes = changes;
+	}
 
-	// Swap these two nodes in the linked list (update ranks)
-	void swap_in_list(Node * node1, Node * node2);
+	// Record a slot whose content changed, NIL stands for the whole tree
+	void touch(Index index) {
+		if (changes != nullptr) {
+			changes->push_back(index);
+		}
+	}
 
-#ifdef NDEBUG
+#ifndef NDEBUG
 public:
 	void check_rank() const;
-	// Debugging routine...dump the link list
+	// Debugging routine...dump the nodes in rank order
 	void dump_list() const;
 
 	// Debugging routine...dump the tree in prefix notation
 	void dump_tree() const;
 
 private:
-	void dump_tree(ConstantNodePointer node) const;
+	void dump_tree(Index index) const;
 #endif // NDEBUG
 
 
@@ -230,317 +408,2071 @@ private:
 	Self & operator=(Self const &) = delete;
 }; // class AdaptiveHuffmanTree
 
-template<typename type>
-AdaptiveHuffmanTree<type>::~AdaptiveHuffmanTree() {
-	for (Node * node = list_head;;) {
-		Node * old_node = node;
-		node = node->next;
-		if (node != nullptr) {
-			if (old_node->weight != node->weight) {
-				delete old_node->block_head;
-			}
-			delete old_node;
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+typename AdaptiveHuffmanTree<type, rescale_bit, location_template>::Index AdaptiveHuffmanTree<type, rescale_bit, location_template>::new_symbol(InternalSymbol symbol) {
+	Index old_nyt_node = node_top;
+	assert(nodes[old_nyt_node].symbol == NYT_SYMBOL && static_cast<Size>(old_nyt_node) + 2 < MAX_NODE_NUM);
+	if (static_cast<Size>(old_nyt_node) + 2 >= nodes.size()) {
+		Size size = nodes.size() * 2 < MAX_NODE_NUM ? nodes.size() * 2 : MAX_NODE_NUM;
+		nodes.resize(size);
+		leaders.resize(size);
+	}
+	node_top += 2;
+
+	// Both new nodes rank lowest, in the block of weight zero
+	Index symbol_node = old_nyt_node + 1;
+	Index new_nyt_node = old_nyt_node + 2;
+	Index block = nodes[old_nyt_node].block;
+	nodes[symbol_node] = Node{symbol, 0, old_nyt_node, NIL, NIL, block};
+	nodes[new_nyt_node] = Node{NYT_SYMBOL, 0, old_nyt_node, NIL, NIL, block};
+
+	nodes[old_nyt_node].symbol = INTERNAL;
+	nodes[old_nyt_node].left = new_nyt_node;
+	nodes[old_nyt_node].right = symbol_node;
+	touch(old_nyt_node);
+
+	location.set(symbol, symbol_node);
+	location.set(NYT_SYMBOL, new_nyt_node);
+	return symbol_node;
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::increse_weight(Index index) {
+	assert(index != NIL);
+
+	Index sibling_of_nyt = NIL;
+	for (; index != NIL; index = nodes[index].parent) {
+		Index leader = leaders[nodes[index].block];
+		if (leader == index) {
+			increment(index);
+		} else if (leader != nodes[index].parent) {
+			swap_nodes(leader, index);
+			increment(leader);
+			index = leader;
 		} else {
-			break;
+			// Only the sibling of NYT weighs as much as its parent, which leads the block
+			// right ahead of it; the parent goes up first, then the sibling leads the block
+			assert(leader + 1 == index && sibling_of_nyt == NIL);
+			sibling_of_nyt = index;
 		}
 	}
-	for (Linker * linker = free_linkers; linker != nullptr;) {
-		Linker * old_linker = linker;
-		linker = reinterpret_cast<Linker *>(*linker);
-		delete old_linker;
+	if (sibling_of_nyt != NIL) {
+		increment(sibling_of_nyt);
 	}
 }
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::new_symbol(InternalSymbol symbol) {
-	assert(list_head->symbol == NYT_SYMBOL);
-
-	Node * symbol_node = get_node(symbol);
-	push_head(symbol_node);
-
-	Node * new_nyt_node = get_node(NYT_SYMBOL);
-	push_head(new_nyt_node);
-
-	Node * old_nyt_node = location[NYT_SYMBOL];
-	assert(old_nyt_node != nullptr && old_nyt_node->left == nullptr && old_nyt_node->right == nullptr);
-	old_nyt_node->symbol = INTERNAL;
-
-	new_nyt_node->parent = symbol_node->parent = old_nyt_node;
-	old_nyt_node->left = new_nyt_node;
-	old_nyt_node->right = symbol_node;
-
-	location[symbol] = symbol_node;
-	location[NYT_SYMBOL] = new_nyt_node;
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::prime(std::vector<std::pair<InternalSymbol, Size>> const & weights) {
+	reset();
+	leaves.clear();
+	leaves.push_back(Node{NYT_SYMBOL, 0, NIL, NIL, NIL, NIL});
+	for (auto const & weight : weights) {
+		assert(weight.second > 0);
+		leaves.push_back(Node{weight.first, weight.second, NIL, NIL, NIL, NIL});
+	}
+	std::stable_sort(leaves.begin() + 1, leaves.end(), [](Node const & node1, Node const & node2) {
+		return node1.weight < node2.weight;
+	});
+	Size node_num = 2 * leaves.size() - 1;
+	assert(node_num < MAX_NODE_NUM);
+	if (node_num + 1 > nodes.size()) {
+		nodes.resize(node_num + 1);
+		leaders.resize(node_num + 1);
+	}
+	node_top = static_cast<Index>(node_num);
+	build();
+	while (RESCALE_LIMIT != 0 && nodes[ROOT].weight >= RESCALE_LIMIT) {
+		rescale();
+	}
 }
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::increse_weight(Node * node) {
-	assert(node != nullptr);
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::assign(Self const & other) {
+	assert(changes == nullptr);
+	if (nodes.size() < other.nodes.size()) {
+		nodes.resize(other.nodes.size());
+		leaders.resize(other.leaders.size());
+	}
+	std::copy(other.nodes.begin(), other.nodes.begin() + other.node_top + 1, nodes.begin());
+	std::copy(other.leaders.begin(), other.leaders.begin() + other.block_top + 1, leaders.begin());
+	node_top = other.node_top;
+	block_top = other.block_top;
+	free_blocks = other.free_blocks;
+	location.assign(other.location);
+}
 
-	if (node->next != nullptr && node->next->weight == node->weight) {
-		Linker head = *node->block_head;
-		assert(head != node && head->parent != node && head->weight == node->weight);
-		if (head != node->parent) {
-			swap_in_tree(head, node);
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::put(typename IO<Byte>::OStream & ostream) const {
+	put_varint(ostream, node_top);
+	for (Index index = ROOT; index <= node_top; ++index) {
+		Node const & node = nodes[index];
+		if (node.symbol == INTERNAL) {
+			// Children fill a pair of slots, the left one second
+			assert(node.right % 2 == 0 && node.left == node.right + 1);
+			put_varint(ostream, 0);
+			put_varint(ostream, node.right / 2);
 		} else {
-			assert(node->next == head);
+			put_varint(ostream, node.symbol + 1);
+			put_varint(ostream, node.weight);
 		}
-		swap_in_list(head, node);
 	}
+}
 
-	if (node->prev != nullptr && node->weight == node->prev->weight) {
-		*node->block_head = node->prev;
-	} else {
-		put_linker(node->block_head);
-		node->block_head = nullptr;
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+bool AdaptiveHuffmanTree<type, rescale_bit, location_template>::get(typename IO<Byte>::IStream & istream) {
+	assert(changes == nullptr);
+	reset();
+	location.erase(NYT_SYMBOL);
+	if (!get_nodes(istream)) {
+		reset();
+		return false;
 	}
+	link_blocks();
+	return true;
+}
 
-	++node->weight;
-
-	if (node->next != nullptr && node->weight == node->next->weight) {
-		node->block_head = node->next->block_head;
-	} else {
-		node->block_head = get_linker(node);
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+bool AdaptiveHuffmanTree<type, rescale_bit, location_template>::get_nodes(typename IO<Byte>::IStream & istream) {
+	UInt64 top;
+	if (!get_varint(istream, top) || top % 2 == 0 || top >= MAX_NODE_NUM) {
+		return false;
+	}
+	if (top + 1 > nodes.size()) {
+		nodes.resize(top + 1);
+		leaders.resize(top + 1);
+	}
+	for (Index index = ROOT; index <= top; ++index) {
+		nodes[index].parent = NIL;
+	}
+	Size internal_count = 0;
+	for (Index index = ROOT; index <= top; ++index) {
+		Node & node = nodes[index];
+		UInt64 code, value;
+		if (!get_varint(istream, code) || !get_varint(istream, value) || code > RUN_SYMBOL + 1) {
+			return false;
+		}
+		node.symbol = code == 0 ? INTERNAL : code - 1;
+		node.left = node.right = NIL;
+		node_top = index;
+		if (code == 0) {
+			// Each pair below the node, and had by no other
+			if (value <= index / 2 || value > top / 2 || nodes[2 * value].parent != NIL) {
+				return false;
+			}
+			node.right = static_cast<Index>(2 * value);
+			node.left = node.right + 1;
+			nodes[node.left].parent = nodes[node.right].parent = index;
+			++internal_count;
+		} else {
+			// Distinct symbols, NYT last and alone at weight zero
+			if (location[node.symbol] != NIL || (node.symbol == NYT_SYMBOL) != (index == top) || (value == 0) != (index == top)) {
+				return false;
+			}
+			node.weight = value;
+			location.set(node.symbol, index);
+		}
+	}
+	if (internal_count != top / 2) {
+		return false;
 	}
 
-	if (node->parent != nullptr) {
-		increse_weight(node->parent);
-		if (node->prev == node->parent) {
-			swap_in_list(node, node->parent);
-			if (*node->block_head == node) {
-				*node->block_head = node->parent;
+	// Children come after their parent, and weights never rise from the root on
+	for (Index index = node_top; index != NIL; --index) {
+		Node & node = nodes[index];
+		if (node.symbol == INTERNAL) {
+			Size left = nodes[node.left].weight, right = nodes[node.right].weight;
+			if (left > std::numeric_limits<Size>::max() - right) {
+				return false;
 			}
+			node.weight = left + right;
+		}
+		if (index != node_top && node.weight < nodes[index + 1].weight) {
+			return false;
 		}
 	}
+	// The parent of NYT ranks right above its sibling, as increse_weight expects
+	return (node_top == ROOT || nodes[node_top].parent == node_top - 2) && (RESCALE_LIMIT == 0 || nodes[ROOT].weight < RESCALE_LIMIT);
 }
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::swap_in_tree(Node * node1, Node * node2) {
-	assert(node1->symbol != NYT_SYMBOL && node2->symbol != NYT_SYMBOL);
-
-	Node * node1_parent = node1->parent;
-	Node * node2_parent = node2->parent;
-
-	if (node1_parent != nullptr) {
-		if (node1_parent->left == node1) {
-			node1_parent->left = node2;
-		} else {
-			assert(node1_parent->right == node1);
-			node1_parent->right = node2;
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::rescale() {
+	// From the last slot back, leaves come sorted by weight, and halving keeps them sorted
+	leaves.clear();
+	for (Index index = node_top; index != NIL; --index) {
+		Node node = nodes[index];
+		if (node.symbol != INTERNAL) {
+			node.weight = (node.weight + 1) / 2; // only NYT has weight zero
+			leaves.push_back(node);
 		}
-	} else {
-		tree_root = node2;
 	}
+	build();
+}
 
-	if (node2_parent != nullptr) {
-		if (node2_parent->left == node2) {
-			node2_parent->left = node1;
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::build() {
+	// Two-queue Huffman construction, filling the slots from the last one back as nodes leave the
+	// queues by nondecreasing weight, which is rank order; internal nodes go first on ties, so the
+	// parent of NYT ranks right above its sibling, as increse_weight expects
+	internals.clear();
+	Size leaf_front = 0, internal_front = 0;
+	Index slot = node_top;
+	auto take = [&]() -> Index {
+		if (leaf_front < leaves.size() && (internal_front == internals.size() || leaves[leaf_front].weight < internals[internal_front].weight)) {
+			nodes[slot] = leaves[leaf_front++];
 		} else {
-			assert(node2_parent->right == node2);
-			node2_parent->right = node1;
+			nodes[slot] = internals[internal_front++];
 		}
-	} else {
-		tree_root = node1;
+		relink(slot);
+		return slot--;
+	};
+	while (leaves.size() - leaf_front + internals.size() - internal_front > 1) {
+		Index left = take();
+		Index right = take();
+		internals.push_back(Node{INTERNAL, nodes[left].weight + nodes[right].weight, NIL, left, right, NIL});
 	}
-
-	node1->parent = node2_parent;
-	node2->parent = node1_parent;
+	take();
+	nodes[ROOT].parent = NIL;
+	assert(slot == NIL);
+	link_blocks();
+	touch(NIL);
 }
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::swap_in_list(Node * node1, Node * node2) {
-	std::swap(node1->next, node2->next);
-	std::swap(node1->prev, node2->prev);
-
-	if (node1->next == node1) {
-		node1->next = node2;
-	}
-	if (node2->next == node2) {
-		node2->next = node1;
-	}
-
-	if (node1->next != nullptr) {
-		node1->next->prev = node1;
-	}
-	if (node2->next != nullptr) {
-		node2->next->prev = node2;
-	}
-
-	if (node1->prev != nullptr) {
-		node1->prev->next = node1;
-	}
-	if (node2->prev != nullptr) {
-		node2->prev->next = node2;
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::link_blocks() {
+	block_top = free_blocks = NIL;
+	for (Index index = ROOT; index <= node_top; ++index) {
+		if (index != ROOT && nodes[index - 1].weight == nodes[index].weight) {
+			nodes[index].block = nodes[index - 1].block;
+		} else {
+			nodes[index].block = get_block(index);
+		}
 	}
-
-	assert(node1->next != node1);
-	assert(node2->next != node2);
 }
 
-#ifdef NDEBUG
+#ifndef NDEBUG
 #include <iostream>
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::check_rank() const {
-	for (ConstantNodePointer node = list_head; node; node = node->next) {
-		assert(node->next == nullpter || node->weight <= node->next->weight);
-		assert(node->block_head != nullpter && *(node->block_head) != nullpter && (*node->block_head)->weight == node->weight);
-		if (node->next != nullpter) {
-			if (node->weight == node->next->weight) {
-				assert(node->block_head == node->next->block_head);
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::check_rank() const {
+	assert(nodes[ROOT].parent == NIL && location[NYT_SYMBOL] == node_top);
+	for (Index index = ROOT; index <= node_top; ++index) {
+		Node const & node = nodes[index];
+		assert(leaders[node.block] <= index && nodes[leaders[node.block]].block == node.block);
+		if (node.symbol == INTERNAL) {
+			assert(nodes[node.left].parent == index && nodes[node.right].parent == index);
+			assert(node.left > index && node.right > index);
+			assert(node.weight == nodes[node.left].weight + nodes[node.right].weight);
+		} else {
+			assert(node.left == NIL && node.right == NIL && location[node.symbol] == index);
+		}
+		if (index != ROOT) {
+			assert(nodes[index - 1].weight >= node.weight);
+			if (nodes[index - 1].weight == node.weight) {
+				assert(nodes[index - 1].block == node.block);
 			} else {
-				assert(node->block_head != node->next->block_head);
+				assert(leaders[node.block] == index);
 			}
 		}
 	}
 }
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::dump_list() const {
-	for (ConstantNodePointer node = list_head; node != nullpter; node = node->next) {
-		std::cout << '[' << node->symbol << ']' << '(' << node->weight << ')';
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::dump_list() const {
+	for (Index index = node_top; index != NIL; --index) {
+		std::cout << '[' << nodes[index].symbol << ']' << '(' << nodes[index].weight << ')';
 	}
 	std::cout << std::endl;
 }
 
-template<typename type>
-inline void AdaptiveHuffmanTree<type>::dump_tree() const {
-	dump_tree(tree_root);
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+inline void AdaptiveHuffmanTree<type, rescale_bit, location_template>::dump_tree() const {
+	dump_tree(ROOT);
 	std::cout << std::endl;
 }
 
-template<typename type>
-void AdaptiveHuffmanTree<type>::dump_tree(ConstantNodePointer node) const {
-	for (; node != nullpter; node = node->right) {
-		std::cout << '[' << node->symbol << ']';
-		if (node->left != nullpter) {
-			assert(node->left->parent == node);
-			dump_tree(node->left);
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void AdaptiveHuffmanTree<type, rescale_bit, location_template>::dump_tree(Index index) const {
+	for (; index != NIL; index = nodes[index].right) {
+		std::cout << '[' << nodes[index].symbol << ']';
+		if (nodes[index].left != NIL) {
+			assert(nodes[nodes[index].left].parent == index);
+			dump_tree(nodes[index].left);
 		}
 
-		if (node->right != nullpter) {
-			assert(node->right->parent == node);
+		if (nodes[index].right != NIL) {
+			assert(nodes[nodes[index].right].parent == index);
 		}
 	}
 }
 #endif // NDEBUG
 
-#include "codec.hpp"
-
-template<typename symbol_type = Byte>
-class AdaptiveHuffmanEncoder : public Encoder<symbol_type> {
+// Vitter's Algorithm V: nodes sit in an array in implicit numbering, the root first, then level by
+// level, so that weights never rise along the array and siblings share a pair of slots (2c, 2c + 1);
+// a block is a run of slots of equal weight and kind, internal nodes ahead of leaves of the same weight.
+// The k-th internal node has the k-th pair as children, so links follow from the blocks alone,
+// and an update slides a node past a whole block at once where FGK swaps it past nodes one by one;
+// the tree stays the shallowest and the sum of code lengths the least among adaptive Huffman trees.
+// Rescaling works as described at AdaptiveHuffmanTree.
+template<typename symbol_type = char, Size rescale_bit = 0, template<typename, Size> class location_template = SymbolIndex>
+class VitterHuffmanTree {
 private:
-	using Self = AdaptiveHuffmanEncoder;
+	using Self = VitterHuffmanTree;
 
 public:
 	using Symbol = symbol_type;
+	using InternalSymbol = UInt64;
 
-	using Base = Encoder<Symbol>;
+	static Size const SYMBOL_BIT = BitSize<Symbol>::value;
+	static Size const SYMBOL_NUM = 1ULL << SYMBOL_BIT;
+	static InternalSymbol const NYT_SYMBOL = SYMBOL_NUM; // id of not yet transmitted
+	static InternalSymbol const RUN_SYMBOL = SYMBOL_NUM + 1; // id of the run escape, a leaf only for coders that add it
+	static InternalSymbol const INTERNAL = SYMBOL_NUM + 2; // id of internal node
+	static Size const NODE_NUM = 2 * SYMBOL_NUM + 4; // capacity of node array, slot 0 is null
 
-private:
-	using Tree = AdaptiveHuffmanTree<Symbol>;
+	static Size const RESCALE_BIT = rescale_bit;
+	static Size const RESCALE_LIMIT = RESCALE_BIT != 0 ? static_cast<Size>(1) << RESCALE_BIT : 0;
 
-	Tree tree;
+	static_assert(RESCALE_BIT == 0 || RESCALE_BIT > SYMBOL_BIT, "rescale_bit must exceed the symbol bits");
 
-public:
-	AdaptiveHuffmanEncoder(typename Base::OStream & os) : Base(os) {
-		// do nothing
+	// Longest code the tree can give, NYT and the run escape included
+	static Size const MAX_CODE_LENGTH = RESCALE_LIMIT != 0 ? rescaled_code_length(RESCALE_LIMIT) : SYMBOL_NUM + 1;
+
+	static InternalSymbol to_internal(Symbol symbol) {
+		return static_cast<UInt64>(static_cast<typename Unsigned<Symbol>::Type>(symbol));
 	}
 
-	Self & put(Symbol symbol) {
-		put_symbol(symbol);
-		tree << symbol;
-		++Base::symbol_count;
-		return *this;
+	static Symbol to_external(InternalSymbol symbol) {
+		return static_cast<Symbol>(static_cast<typename Unsigned<Symbol>::Type>(symbol));
 	}
 
 private:
-	// Send a symbol
-	void put_symbol(Symbol symbol) {
-		auto cursor = tree[symbol];
-		if (cursor.is_null()) {
-			// Symbol hasn't been transmitted, send a NYT, then the symbol
-			encode_and_put(tree.nyt());
-			Base::put_plain(symbol);
-		} else {
-			encode_and_put(cursor);
+	// Nodes are known by their slot, which they leave when they slide
+	using Index = typename Conditional<(NODE_NUM <= 0x10000), UInt16, UInt32>::Type;
+
+	static Index const NIL = 0;
+	static Index const ROOT = 1;
+
+	static Size const MAX_NODE_NUM = NODE_NUM < static_cast<Size>(std::numeric_limits<Index>::max()) ? NODE_NUM : static_cast<Size>(std::numeric_limits<Index>::max());
+	static Size const INITIAL_NODE_NUM = MAX_NODE_NUM < 1024 ? MAX_NODE_NUM : 1024;
+
+	using Location = location_template<Index, SYMBOL_BIT>;
+
+	struct Node {
+		InternalSymbol symbol;
+		Size weight;
+		Index block;
+	};
+
+	struct Block {
+		Index leader; /* first slot, or the next free block */
+		Index child; /* pair below the leader, for internal blocks */
+	};
+
+public:
+	class Cursor {
+	private:
+		using Self = Cursor;
+
+	private:
+		VitterHuffmanTree const * tree;
+		Index index;
+
+	public:
+		Cursor(VitterHuffmanTree const * tree, Index index) : tree(tree), index(index) {
+			// do nothing
 		}
-	}
 
-	// Encode symbol and send code
-	void encode_and_put(typename Tree::Cursor cursor) {
-		if (!cursor.is_null()) {
-			encode_and_put(cursor.parent());
-			if (!cursor.is_root()) {
-				Base::put_bit(cursor.side());
-			}
+		InternalSymbol symbol() const {
+			return tree->nodes[index].symbol;
 		}
-	}
 
-private:
-	AdaptiveHuffmanEncoder(Self const &) = delete;
-	Self & operator=(Self const &) = delete;
-}; // class AdaptiveHuffmanEncoder
+		bool is_null() const {
+			return index == NIL;
+		}
+
+		bool is_root() const {
+			return index == ROOT;
+		}
+
+		bool is_left_child() const {
+			return side() == Bit::zero;
+		}
+
+		bool is_right_child() const {
+			return side() == Bit::one;
+		}
+
+		Bit side() const {
+			assert(!is_root());
+			return tree->side_of(index);
+		}
+
+		Self parent() const {
+			return Self(tree, tree->parent_node(index));
+		}
+
+		Self left() const {
+			return Self(tree, tree->child_node(index, Bit::zero));
+		}
+
+		Self right() const {
+			return Self(tree, tree->child_node(index, Bit::one));
+		}
+
+		Self & up() {
+			index = tree->parent_node(index);
+			return *this;
+		}
+
+		Self & down_left() {
+			return down(Bit::zero);
+		}
+
+		Self & down_right() {
+			return down(Bit::one);
+		}
+
+		Self & down(Bit bit) {
+			index = tree->child_node(index, bit);
+			return *this;
+		}
+	}; // class Cursor
 
-template<typename symbol_type = Byte>
-class AdaptiveHuffmanDecoder : public Decoder<symbol_type> {
 private:
-	using Self = AdaptiveHuffmanDecoder;
+	std::vector<Node> nodes; /* in implicit numbering, nodes[ROOT] is the root and nodes[node_top] is NYT */
+	std::vector<Block> blocks;
+	std::vector<Index> owners; /* block of the parent of each pair */
+	Index node_top;
+	Index block_top;
+	Index free_blocks;
+	Location location;
+	std::vector<Index> * changes; /* slots whose content changed, while a lookup is attached */
+	Size change_limit; /* first slot too deep for the lookup */
+	std::vector<Node> leaves, internals; /* kept for rescale */
+
+	template<typename, Size>
+	friend class AdaptiveHuffmanLookup;
 
 public:
-	using Symbol = symbol_type;
+	VitterHuffmanTree() : nodes(INITIAL_NODE_NUM), blocks(INITIAL_NODE_NUM), owners(INITIAL_NODE_NUM / 2 + 1), node_top(NIL), changes(nullptr), change_limit(0) {
+		reset();
+	}
 
-	using Base = Decoder<Symbol>;
+	// Forget every symbol, going back to the lone NYT node; costs as much as the nodes in use
+	void reset() {
+		for (Index index = ROOT; index <= node_top; ++index) {
+			if (nodes[index].symbol != INTERNAL) {
+				location.erase(nodes[index].symbol);
+			}
+		}
+		node_top = ROOT;
+		block_top = free_blocks = NIL;
+		nodes[ROOT] = Node{NYT_SYMBOL, 0, get_block(ROOT)};
+		location.set(NYT_SYMBOL, ROOT);
+		if (changes != nullptr) {
+			changes->clear();
+		}
+		touch(NIL);
+	}
 
-private:
-	using Tree = AdaptiveHuffmanTree<Symbol>;
+	Cursor root() const {
+		return Cursor(this, ROOT);
+	}
 
-	Tree tree;
+	Cursor operator[](InternalSymbol symbol) const {
+		return Cursor(this, location[symbol]);
+	}
 
-public:
-	AdaptiveHuffmanDecoder(typename Base::IStream & is) : Base(is) {
-		// do nothing
+	Cursor operator[](Symbol symbol) const {
+		return (*this)[to_internal(symbol)];
 	}
 
-	Symbol get() {
-		auto symbol = get_symbol();
-		tree << symbol;
-		--Base::symbol_count;
-		return symbol;
+	Cursor nyt() const {
+		return (*this)[NYT_SYMBOL];
 	}
 
-private:
-	// Get a symbol
-	Symbol get_symbol() {
-		auto cursor = tree.root();
-		for (; !cursor.is_null() && cursor.symbol() == Tree::INTERNAL; ) {
-			cursor.down(Base::get_bit());
-		}
-		if (cursor.symbol() == Tree::NYT_SYMBOL) {
-			return Base::get_plain();
-		} else {
-			return Tree::to_external(cursor.symbol());
+	Self & operator<<(Symbol symbol) {
+		return *this << to_internal(symbol);
+	}
+
+	// Start over from the given symbols and weights, all above zero, as if they had been counted;
+	// the tree takes the Huffman shape of the weights, which counting them one by one may not give
+	void prime(std::vector<std::pair<InternalSymbol, Size>> const & weights);
+
+	// Become a copy of other, reusing the storage held; a lookup watching this tree has to be reset first
+	void assign(Self const & other);
+
+	// A copy of the tree, for a coder to start from where this one stands
+	std::unique_ptr<Self> clone() const {
+		std::unique_ptr<Self> copy(new Self());
+		copy->assign(*this);
+		return copy;
+	}
+
+	// Write the tree as it stands, so that get gives back one that codes alike: the last slot (varint), then
+	// from the root on, for each internal node 0 (varint), for each leaf its symbol plus one and its weight
+	// (varint each); children follow from the implicit numbering
+	void put(typename IO<Byte>::OStream & ostream) const;
+
+	// Become the tree written by put, false and reset if the input is not one; a lookup watching this tree has to be reset first
+	bool get(typename IO<Byte>::IStream & istream);
+
+	// Count one more of a symbol, or of the run escape
+	Self & operator<<(InternalSymbol symbol) {
+		update(symbol);
+		if (RESCALE_LIMIT != 0 && nodes[ROOT].weight >= RESCALE_LIMIT) {
+			rescale();
 		}
+		return *this;
 	}
 
 private:
-	AdaptiveHuffmanDecoder(Self const &) = delete;
-	Self & operator=(Self const &) = delete;
-}; // class AdaptiveHuffmanDecoder
+	// Count one more of symbol
+	void update(InternalSymbol symbol);
 
-template<typename symbol_type = Byte>
-class AdaptiveHuffmanCodec : public Codec<symbol_type, AdaptiveHuffmanEncoder<symbol_type>, AdaptiveHuffmanDecoder<symbol_type>> {
-private:
-	using Self = AdaptiveHuffmanCodec;
+	// Split the NYT node, returns the slot that became internal
+	Index new_symbol(InternalSymbol symbol);
 
-public:
-	using Symbol = symbol_type;
+	// Increment the node at index, first sliding it past the block ahead if the order asks so;
+	// returns the next node to increment
+	Index slide_and_increment(Index index);
 
-	using Encoder = AdaptiveHuffmanEncoder<Symbol>;
-	using Decoder = AdaptiveHuffmanDecoder<Symbol>;
+	// Halve the weights and rebuild the tree from them
+	void rescale();
 
-	using Base = Codec<Symbol, Encoder, Decoder>;
+	// Fill the slots up to node_top from leaves, sorted by weight from the lightest, NYT first
+	void build();
 
-}; // class AdaptiveHuffmanCodec
+	// Give each run of equal weights and kind a block, and each internal node the next pair
+	void link_blocks();
+
+	// Read the nodes for get, setting node_top to the last slot filled so far
+	bool get_nodes(typename IO<Byte>::IStream & istream);
+
+	// Pair below an internal node
+	Index child_of(Index index) const {
+		Block const & block = blocks[nodes[index].block];
+		return block.child + (index - block.leader);
+	}
+
+	Index parent_of(Index index) const {
+		Index pair = index >> 1;
+		Block const & block = blocks[owners[pair]];
+		return block.leader + (pair - block.child);
+	}
+
+	// Join the block ahead when it has the same weight and kind, else start a block;
+	// child is the pair below an internal node
+	void attach(Index index, Index child) {
+		Node & node = nodes[index];
+		Node const & ahead = nodes[index - 1];
+		if (index != ROOT && ahead.weight == node.weight && (ahead.symbol == INTERNAL) == (node.symbol == INTERNAL)) {
+			node.block = ahead.block;
+			assert(node.symbol != INTERNAL || blocks[node.block].child + (index - blocks[node.block].leader) == child);
+		} else {
+			node.block = get_block(index);
+			blocks[node.block].child = child;
+		}
+		if (node.symbol == INTERNAL) {
+			owners[child] = node.block;
+		}
+	}
+
+	// Hand the block led by index on to the slot behind, or free it
+	void detach(Index index) {
+		Index block = nodes[index].block;
+		assert(blocks[block].leader == index);
+		if (index < node_top && nodes[index + 1].block == block) {
+			++blocks[block].leader;
+			++blocks[block].child;
+		} else {
+			blocks[block].leader = free_blocks;
+			free_blocks = block;
+		}
+	}
+
+	Index get_block(Index leader) {
+		Index block;
+		if (free_blocks != NIL) {
+			block = free_blocks;
+			free_blocks = blocks[block].leader;
+		} else {
+			// Blocks are never empty, so they never outnumber nodes
+			assert(block_top < node_top);
+			block = ++block_top;
+		}
+		blocks[block].leader = leader;
+		return block;
+	}
+
+	// Tree shape as the lookup sees it
+	Index root_node() const {
+		return ROOT;
+	}
+
+	Index parent_node(Index index) const {
+		return index != ROOT ? parent_of(index) : NIL;
+	}
+
+	// The pair (2c, 2c + 1) holds the right child first, the left one second
+	Index child_node(Index index, Bit bit) const {
+		return nodes[index].symbol != INTERNAL ? NIL : 2 * child_of(index) + (bit == Bit::zero ? 1 : 0);
+	}
+
+	Bit side_of(Index index) const {
+		return (index & 1) != 0 ? Bit::zero : Bit::one;
+	}
+
+	bool is_leaf(Index index) const {
+		return nodes[index].symbol != INTERNAL;
+	}
+
+	Cursor cursor(Index index) const {
+		return Cursor(this, index);
+	}
+
+	// Start or stop recording changes for a lookup down to depth; levels fill the array in order,
+	// so the slots from 1 << depth on lie deeper and are left out
+	void watch(std::vector<Index> * changes, Size depth) {
+		this->changes = changes;
+		change_limit = changes != nullptr ? static_cast<Size>(1) << depth : 0;
+	}
+
+	// Record a slot whose content changed, NIL stands for the whole tree
+	void touch(Index index) {
+		if (changes != nullptr && index < change_limit) {
+			changes->push_back(index);
+		}
+	}
+
+#ifndef NDEBUG
+public:
+	void check_rank() const;
+
+	// Debugging routine...dump the nodes in implicit numbering
+	void dump_list() const;
+#endif // NDEBUG
+
+private:
+	VitterHuffmanTree(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class VitterHuffmanTree
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::update(InternalSymbol symbol) {
+	Index index = location[symbol];
+	Index leaf = NIL; /* leaf to increment after its parent */
+	if (index == NIL) {
+		index = new_symbol(symbol);
+		leaf = index + 1;
+	} else {
+		// Take the place of the leader of the block, leaves of equal weight are interchangeable
+		Index leader = blocks[nodes[index].block].leader;
+		if (leader != index) {
+			std::swap(nodes[leader].symbol, nodes[index].symbol);
+			location.set(nodes[leader].symbol, leader);
+			location.set(nodes[index].symbol, index);
+			touch(leader);
+			touch(index);
+			index = leader;
+		}
+		if (index == node_top - 1) {
+			// The sibling of NYT weighs as much as its parent, which has to go first
+			leaf = index;
+			index = parent_of(index);
+		}
+	}
+	while (index != NIL) {
+		index = slide_and_increment(index);
+	}
+	if (leaf != NIL) {
+		slide_and_increment(leaf);
+	}
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+typename VitterHuffmanTree<type, rescale_bit, location_template>::Index VitterHuffmanTree<type, rescale_bit, location_template>::new_symbol(InternalSymbol symbol) {
+	Index index = node_top;
+	assert(nodes[index].symbol == NYT_SYMBOL && static_cast<Size>(index) + 2 < MAX_NODE_NUM);
+	if (static_cast<Size>(index) + 2 >= nodes.size()) {
+		Size size = nodes.size() * 2 < MAX_NODE_NUM ? nodes.size() * 2 : MAX_NODE_NUM;
+		nodes.resize(size);
+		blocks.resize(size);
+		owners.resize(size / 2 + 1);
+	}
+	node_top += 2;
+
+	// The old NYT is alone in its block, and keeps it as it turns internal over the new leaf and NYT
+	Index pair = (index + 1) >> 1;
+	Index block = nodes[index].block;
+	nodes[index].symbol = INTERNAL;
+	blocks[block].child = pair;
+	owners[pair] = block;
+	block = get_block(index + 1);
+	nodes[index + 1] = Node{symbol, 0, block};
+	nodes[index + 2] = Node{NYT_SYMBOL, 0, block};
+	location.set(symbol, index + 1);
+	location.set(NYT_SYMBOL, index + 2);
+	touch(index);
+	return index;
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+typename VitterHuffmanTree<type, rescale_bit, location_template>::Index VitterHuffmanTree<type, rescale_bit, location_template>::slide_and_increment(Index index) {
+	Node node = nodes[index];
+	bool internal = node.symbol == INTERNAL;
+	Index child = internal ? child_of(index) : NIL;
+	Index parent = parent_node(index);
+
+	// Leaves slide past internal nodes of their weight, internal nodes past leaves one heavier
+	Index target = index;
+	if (index != ROOT) {
+		Node const & ahead = nodes[index - 1];
+		if ((ahead.symbol == INTERNAL) != internal && ahead.weight == node.weight + (internal ? 1 : 0)) {
+			target = blocks[ahead.block].leader;
+		} else if (ahead.weight > node.weight + 1 && (index == node_top || nodes[index + 1].block != node.block)) {
+			// Alone in its block before and after, as heavy nodes mostly are
+			++nodes[index].weight;
+			return parent;
+		}
+	}
+
+	detach(index);
+	if (target != index) {
+		nodes[index] = nodes[target];
+		++blocks[nodes[target].block].leader;
+		if (internal) {
+			// Leaves of the block are interchangeable, the first one takes the place left
+			location.set(nodes[index].symbol, index);
+			touch(index);
+		} else {
+			// Internal nodes of the block differ only by the pair below, which follows from their
+			// offset in the block, so moving the leader on shifts them all
+			for (Index i = target + 1; i <= index && i < change_limit; ++i) {
+				touch(i);
+			}
+		}
+		nodes[target] = node;
+		if (!internal) {
+			location.set(node.symbol, target);
+		}
+		touch(target);
+	}
+	++nodes[target].weight;
+	attach(target, child);
+
+	if (target != index && !internal) {
+		return parent_of(target);
+	}
+	return parent;
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::prime(std::vector<std::pair<InternalSymbol, Size>> const & weights) {
+	reset();
+	leaves.clear();
+	leaves.push_back(Node{NYT_SYMBOL, 0, NIL});
+	for (auto const & weight : weights) {
+		assert(weight.second > 0);
+		leaves.push_back(Node{weight.first, weight.second, NIL});
+	}
+	std::stable_sort(leaves.begin() + 1, leaves.end(), [](Node const & node1, Node const & node2) {
+		return node1.weight < node2.weight;
+	});
+	Size node_num = 2 * leaves.size() - 1;
+	assert(node_num < MAX_NODE_NUM);
+	if (node_num + 1 > nodes.size()) {
+		nodes.resize(node_num + 1);
+		blocks.resize(node_num + 1);
+		owners.resize((node_num + 1) / 2 + 1);
+	}
+	node_top = static_cast<Index>(node_num);
+	build();
+	while (RESCALE_LIMIT != 0 && nodes[ROOT].weight >= RESCALE_LIMIT) {
+		rescale();
+	}
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::assign(Self const & other) {
+	assert(changes == nullptr);
+	if (nodes.size() < other.nodes.size()) {
+		nodes.resize(other.nodes.size());
+		blocks.resize(other.blocks.size());
+		owners.resize(other.owners.size());
+	}
+	std::copy(other.nodes.begin(), other.nodes.begin() + other.node_top + 1, nodes.begin());
+	std::copy(other.blocks.begin(), other.blocks.begin() + other.block_top + 1, blocks.begin());
+	std::copy(other.owners.begin(), other.owners.begin() + other.node_top / 2 + 1, owners.begin());
+	node_top = other.node_top;
+	block_top = other.block_top;
+	free_blocks = other.free_blocks;
+	location.assign(other.location);
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::put(typename IO<Byte>::OStream & ostream) const {
+	put_varint(ostream, node_top);
+	for (Index index = ROOT; index <= node_top; ++index) {
+		Node const & node = nodes[index];
+		if (node.symbol == INTERNAL) {
+			put_varint(ostream, 0);
+		} else {
+			put_varint(ostream, node.symbol + 1);
+			put_varint(ostream, node.weight);
+		}
+	}
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+bool VitterHuffmanTree<type, rescale_bit, location_template>::get(typename IO<Byte>::IStream & istream) {
+	assert(changes == nullptr);
+	reset();
+	location.erase(NYT_SYMBOL);
+	if (!get_nodes(istream)) {
+		reset();
+		return false;
+	}
+	link_blocks();
+	return true;
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+bool VitterHuffmanTree<type, rescale_bit, location_template>::get_nodes(typename IO<Byte>::IStream & istream) {
+	UInt64 top;
+	if (!get_varint(istream, top) || top % 2 == 0 || top >= MAX_NODE_NUM) {
+		return false;
+	}
+	if (top + 1 > nodes.size()) {
+		nodes.resize(top + 1);
+		blocks.resize(top + 1);
+		owners.resize((top + 1) / 2 + 1);
+	}
+	Index pair = ROOT; /* below the next internal node */
+	for (Index index = ROOT; index <= top; ++index) {
+		Node & node = nodes[index];
+		UInt64 code, weight = 0;
+		if (!get_varint(istream, code) || (code != 0 && !get_varint(istream, weight)) || code > RUN_SYMBOL + 1) {
+			return false;
+		}
+		node.symbol = code == 0 ? INTERNAL : code - 1;
+		node_top = index;
+		if (code == 0) {
+			// Each pair below its node
+			if (pair <= index / 2 || pair > top / 2) {
+				return false;
+			}
+			++pair;
+		} else {
+			// Distinct symbols, NYT last and alone at weight zero
+			if (location[node.symbol] != NIL || (node.symbol == NYT_SYMBOL) != (index == top) || (weight == 0) != (index == top)) {
+				return false;
+			}
+			node.weight = weight;
+			location.set(node.symbol, index);
+		}
+	}
+	if (pair != top / 2 + 1) {
+		return false;
+	}
+
+	// Weights never rise from the root on, and internal nodes go ahead of leaves of their weight
+	for (Index index = node_top; index != NIL; --index) {
+		Node & node = nodes[index];
+		if (node.symbol == INTERNAL) {
+			--pair;
+			Size left = nodes[2 * pair + 1].weight, right = nodes[2 * pair].weight;
+			if (left > std::numeric_limits<Size>::max() - right) {
+				return false;
+			}
+			node.weight = left + right;
+		}
+		if (index != node_top) {
+			Node const & behind = nodes[index + 1];
+			if (node.weight < behind.weight || (node.weight == behind.weight && node.symbol != INTERNAL && behind.symbol == INTERNAL)) {
+				return false;
+			}
+		}
+	}
+	return RESCALE_LIMIT == 0 || nodes[ROOT].weight < RESCALE_LIMIT;
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::rescale() {
+	// From the last slot back, leaves come sorted by weight, and halving keeps them sorted
+	leaves.clear();
+	for (Index index = node_top; index != NIL; --index) {
+		Node node = nodes[index];
+		if (node.symbol != INTERNAL) {
+			node.weight = (node.weight + 1) / 2; // only NYT has weight zero
+			leaves.push_back(node);
+		}
+	}
+	build();
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::build() {
+	// Two-queue Huffman construction, filling the slots from the last one back as nodes leave the
+	// queues by nondecreasing weight; leaves go first on ties, and internal nodes leave in the order
+	// their pairs were filled, so the result is again in implicit numbering with NYT last
+	internals.clear();
+	Size leaf_front = 0, internal_front = 0;
+	Index slot = node_top;
+	auto take = [&]() -> Size {
+		if (leaf_front < leaves.size() && (internal_front == internals.size() || leaves[leaf_front].weight <= internals[internal_front].weight)) {
+			nodes[slot] = leaves[leaf_front++];
+			location.set(nodes[slot].symbol, slot);
+		} else {
+			nodes[slot] = internals[internal_front++];
+		}
+		return nodes[slot--].weight;
+	};
+	while (leaves.size() - leaf_front + internals.size() - internal_front > 1) {
+		Size weight = take();
+		weight += take();
+		internals.push_back(Node{INTERNAL, weight, NIL});
+	}
+	take();
+	assert(slot == NIL);
+	link_blocks();
+	touch(NIL);
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::link_blocks() {
+	block_top = free_blocks = NIL;
+	Index pair = ROOT;
+	for (Index index = ROOT; index <= node_top; ++index) {
+		attach(index, nodes[index].symbol == INTERNAL ? pair++ : NIL);
+	}
+}
+
+#ifndef NDEBUG
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::check_rank() const {
+	assert(nodes[node_top].symbol == NYT_SYMBOL && nodes[node_top].weight == 0 && location[NYT_SYMBOL] == node_top);
+	Index pair = ROOT;
+	for (Index index = ROOT; index <= node_top; ++index) {
+		Node const & node = nodes[index];
+		assert(blocks[node.block].leader <= index && nodes[blocks[node.block].leader].block == node.block);
+		if (node.symbol == INTERNAL) {
+			assert(child_of(index) == pair && owners[pair] == node.block && parent_of(2 * pair) == index);
+			assert(node.weight == nodes[2 * pair].weight + nodes[2 * pair + 1].weight);
+			++pair;
+		} else {
+			assert(location[node.symbol] == index);
+		}
+		if (index != ROOT) {
+			Node const & ahead = nodes[index - 1];
+			bool same = ahead.weight == node.weight && (ahead.symbol == INTERNAL) == (node.symbol == INTERNAL);
+			assert(ahead.weight >= node.weight);
+			assert(ahead.weight > node.weight || ahead.symbol == INTERNAL || node.symbol != INTERNAL);
+			assert(same ? ahead.block == node.block : blocks[node.block].leader == index);
+		}
+	}
+	assert(2 * pair == node_top + 1);
+}
+
+template<typename type, Size rescale_bit, template<typename, Size> class location_template>
+void VitterHuffmanTree<type, rescale_bit, location_template>::dump_list() const {
+	for (Index index = ROOT; index <= node_top; ++index) {
+		std::cout << '[' << nodes[index].symbol << ']' << '(' << nodes[index].weight << ')';
+	}
+	std::cout << std::endl;
+}
+#endif // NDEBUG
+
+// Maps the next lookup_bit bits of input to the node they lead to from the root,
+// patched after each update for the subtrees whose shape changed; it is only built
+// once the tree has seen LOOKUP_WARMUP updates, so short messages never pay for it
+template<typename tree_type, Size lookup_bit = 10>
+class AdaptiveHuffmanLookup {
+private:
+	using Self = AdaptiveHuffmanLookup;
+
+public:
+	using Tree = tree_type;
+	using Symbol = typename Tree::Symbol;
+
+	static Size const LOOKUP_BIT = lookup_bit;
+	static Size const LOOKUP_NUM = static_cast<Size>(1) << LOOKUP_BIT;
+	static Size const LOOKUP_WARMUP = LOOKUP_NUM / 4;
+
+private:
+	using Index = typename Tree::Index;
+
+	static Index const NIL = Tree::NIL;
+
+public:
+	struct Entry {
+		Index node;
+		UInt8 length; /* bits consumed to reach node */
+	};
+
+private:
+	Tree & tree;
+	Entry entries[LOOKUP_NUM];
+	std::vector<Index> changes;
+	Size warmup; /* updates left before the table is built */
+
+public:
+	AdaptiveHuffmanLookup(Tree & tree) : tree(tree), warmup(LOOKUP_WARMUP) {
+		// do nothing
+	}
+
+	~AdaptiveHuffmanLookup() {
+		reset();
+	}
+
+	// Whether entries can be used
+	bool is_active() const {
+		return warmup == 0;
+	}
+
+	// Drop the table, after the tree was reset
+	void reset() {
+		if (is_active()) {
+			assert(tree.changes == &changes);
+			tree.watch(nullptr, 0);
+			changes.clear();
+		}
+		warmup = LOOKUP_WARMUP;
+	}
+
+	Entry const & operator[](UInt32 bits) const {
+		assert(bits < LOOKUP_NUM);
+		return entries[bits];
+	}
+
+	typename Tree::Cursor cursor(Entry const & entry) const {
+		return tree.cursor(entry.node);
+	}
+
+	// Bring the entries in line with the tree after an update
+	void update() {
+		if (!is_active()) {
+			if (--warmup == 0) {
+				assert(tree.changes == nullptr);
+				tree.watch(&changes, LOOKUP_BIT);
+				rebuild();
+			}
+			return;
+		}
+		for (Index index : changes) {
+			refresh(index);
+		}
+		changes.clear();
+	}
+
+private:
+	void rebuild() {
+		fill(tree.root_node(), 0, 0);
+	}
+
+	void refresh(Index index) {
+		if (index == NIL) {
+			rebuild();
+			return;
+		}
+		Size depth = 0;
+		UInt32 prefix = 0;
+		for (Index node = index; node != tree.root_node(); node = tree.parent_node(node)) {
+			if (++depth >= LOOKUP_BIT) {
+				return; // children lie below the table
+			}
+			prefix = (prefix << 1) | static_cast<UInt32>(tree.side_of(node));
+		}
+		fill(index, depth, prefix);
+	}
+
+	void fill(Index index, Size depth, UInt32 prefix) {
+		if (depth == LOOKUP_BIT || tree.is_leaf(index)) {
+			for (UInt32 rest = 0; rest < (static_cast<UInt32>(1) << (LOOKUP_BIT - depth)); ++rest) {
+				entries[prefix | (rest << depth)] = Entry{index, static_cast<UInt8>(depth)};
+			}
+		} else {
+			fill(tree.child_node(index, Bit::zero), depth + 1, prefix);
+			fill(tree.child_node(index, Bit::one), depth + 1, prefix | (static_cast<UInt32>(1) << depth));
+		}
+	}
+
+private:
+	AdaptiveHuffmanLookup(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class AdaptiveHuffmanLookup
+
+// How the tree follows the counts; the model byte of the stream header names the one a stream was coded with
+struct FGKUpdate {
+	static Byte const MODEL = 0;
+
+	template<typename symbol_type, Size rescale_bit>
+	using Tree = AdaptiveHuffmanTree<symbol_type, rescale_bit>;
+};
+
+struct VitterUpdate {
+	static Byte const MODEL = 1;
+
+	template<typename symbol_type, Size rescale_bit>
+	using Tree = VitterHuffmanTree<symbol_type, rescale_bit>;
+};
+
+/*
+ * With run_escape, the coders keep a run escape leaf in the tree, next to NYT, from every reset on at
+ * weight one. The escape stands for length repeats of the last symbol coded, length >= MIN_LENGTH: after
+ * its code, n, the bit length of length - MIN_LENGTH + 1 less one, comes as a symbol of a second adaptive
+ * tree (through NYT and 8 plain bits the first time), then the n bits below the top one. Fewer repeats are
+ * coded one by one. The last symbol is Symbol() after a reset, and runs end with their frame. A run costs
+ * a few bits and two tree updates however long it is, and the header carries the RUN flag.
+ */
+struct AdaptiveHuffmanRuns {
+	static Size const MIN_LENGTH = 4;
+	static Size const MAX_LENGTH = static_cast<Size>(1) << 24; // longer runs take several escapes
+	static Size const LENGTH_BIT = 24; // n is below it
+
+	static Size const MAX_FRAME_COUNT = 0xFFFFFFFF; // symbols a frame header can count, which runs could pass
+};
+
+// How the last symbols pick the tree of the next; NoContext keeps one tree for the whole stream
+struct NoContext {
+	static Size const ORDER = 0;
+	static Size const CONTEXT_BIT = 0;
+	static Size const TREE_BIT = 0;
+};
+
+/*
+ * The last order symbols pick the tree the next symbol is coded with, so that each context learns
+ * its own counts; contexts wider than context_bit bits are hashed down to that, and may then share a
+ * tree. Trees are made as their contexts first show up, at most 1 << tree_bit of them; past that, a
+ * clock sweep hands the tree of a context not picked lately to the new one, which starts afresh. Both
+ * sides pick alike, so nothing of this is sent beyond the CONTEXT flag and the three parameters in the
+ * header. A reset forgets every context, and the symbols before the first count as Symbol().
+ */
+template<Size order = 1, Size context_bit = 16, Size tree_bit = 8>
+struct SymbolContext {
+	static Size const ORDER = order;
+	static Size const CONTEXT_BIT = context_bit;
+	static Size const TREE_BIT = tree_bit;
+
+	static_assert(ORDER > 0 && CONTEXT_BIT > 0, "a context needs a symbol and a bit at least");
+	static_assert(CONTEXT_BIT <= 24 && TREE_BIT <= 24, "context and tree bits are at most 24");
+};
+
+// Models of the contexts seen since the last reset, as described at SymbolContext; model_type
+// is made from source on first use and resets itself, models of forgotten or evicted contexts are reused
+template<typename model_type, Size symbol_bit, typename context_type>
+class ContextBank {
+private:
+	using Self = ContextBank;
+
+public:
+	using Model = model_type;
+	using InternalSymbol = UInt64;
+
+	static Size const ORDER = context_type::ORDER;
+	static Size const WINDOW_BIT = ORDER * symbol_bit;
+	static Size const KEY_BIT = WINDOW_BIT < context_type::CONTEXT_BIT ? WINDOW_BIT : context_type::CONTEXT_BIT;
+	static Size const KEY_NUM = static_cast<Size>(1) << KEY_BIT;
+	static Size const MAX_MODEL_NUM = (static_cast<Size>(1) << context_type::TREE_BIT) < KEY_NUM ? static_cast<Size>(1) << context_type::TREE_BIT : KEY_NUM;
+
+	static_assert(WINDOW_BIT <= BitSize<UInt64>::value, "the last symbols must fit a word");
+
+private:
+	std::vector<std::unique_ptr<Model>> models; /* made as needed, the first model_count in use */
+	std::vector<UInt32> keys; /* context of each model in use */
+	std::vector<Byte> used; /* whether each model was picked since the clock last passed it */
+	std::vector<UInt32> slots; /* model of each context plus one, zero for none */
+	Size model_count;
+	Size hand; /* next model the clock looks at */
+	UInt64 window; /* the last ORDER symbols, the latest lowest */
+	typename Model::Source source;
+
+public:
+	explicit ContextBank(typename Model::Source source) : slots(KEY_NUM, 0), model_count(0), hand(0), window(0), source(source) {
+		// do nothing
+	}
+
+	// Forget every context, and give the model of the first
+	Model & reset() {
+		clear();
+		hand = 0;
+		window = 0;
+		return select();
+	}
+
+	// Give the model of the context after count more of symbol
+	Model & next(InternalSymbol symbol, Size count = 1) {
+		if (ORDER == 0) {
+			return *models.front();
+		}
+		for (Size i = 0; i < count && i < ORDER; ++i) {
+			window = ORDER == 1 ? symbol : ((window << symbol_bit) | symbol) & low_mask(WINDOW_BIT);
+		}
+		return select();
+	}
+
+	// The model of the current context
+	Model & current() {
+		return *models[slots[key_of(window)] - 1];
+	}
+
+	// Become a copy of other, models included, and give the model of the current context
+	Model & assign(Self const & other) {
+		clear();
+		for (Size i = 0; i < other.model_count; ++i) {
+			make(i).assign(*other.models[i]);
+			keys[i] = other.keys[i];
+			used[i] = other.used[i];
+			slots[keys[i]] = static_cast<UInt32>(i) + 1;
+		}
+		model_count = other.model_count;
+		hand = other.hand;
+		window = other.window;
+		return current();
+	}
+
+	// Write the contexts and their models: the last symbols, the clock hand and the number of models,
+	// then for each model its context, whether it was picked lately (varint each) and the model itself
+	void put(typename IO<Byte>::OStream & ostream) const {
+		put_varint(ostream, window);
+		put_varint(ostream, hand);
+		put_varint(ostream, model_count);
+		for (Size i = 0; i < model_count; ++i) {
+			put_varint(ostream, keys[i]);
+			put_varint(ostream, used[i]);
+			models[i]->put(ostream);
+		}
+	}
+
+	// Read what put wrote, false if the input is not that; the owner resets the bank after a failure
+	bool get(typename IO<Byte>::IStream & istream) {
+		clear();
+		UInt64 window, hand, count;
+		if (!get_varint(istream, window) || !get_varint(istream, hand) || !get_varint(istream, count)
+			|| window > low_mask(WINDOW_BIT) || hand >= MAX_MODEL_NUM || count == 0 || count > MAX_MODEL_NUM) {
+			return false;
+		}
+		this->window = window;
+		this->hand = static_cast<Size>(hand);
+		for (Size i = 0; i < count; ++i) {
+			UInt64 key, picked;
+			if (!get_varint(istream, key) || !get_varint(istream, picked) || key >= KEY_NUM || slots[key] != 0 || picked > 1) {
+				return false;
+			}
+			Model & model = make(i);
+			keys[i] = static_cast<UInt32>(key);
+			used[i] = static_cast<Byte>(picked);
+			slots[key] = static_cast<UInt32>(i) + 1;
+			model_count = i + 1;
+			if (!model.get(istream)) {
+				return false;
+			}
+		}
+		return slots[key_of(window)] != 0;
+	}
+
+private:
+	// Unlink every model from its context
+	void clear() {
+		for (Size i = 0; i < model_count; ++i) {
+			slots[keys[i]] = 0;
+		}
+		model_count = 0;
+	}
+
+	// Model at index, made if it is the first past those made
+	Model & make(Size index) {
+		if (index == models.size()) {
+			models.emplace_back(new Model(source));
+			keys.push_back(0);
+			used.push_back(0);
+		}
+		return *models[index];
+	}
+
+	Size key_of(UInt64 window) const {
+		if (WINDOW_BIT <= KEY_BIT) {
+			return static_cast<Size>(window);
+		}
+		return static_cast<Size>((window * 0x9E3779B97F4A7C15ULL) >> (KEY_BIT != 0 ? BitSize<UInt64>::value - KEY_BIT : 0));
+	}
+
+	Model & select() {
+		UInt32 & slot = slots[key_of(window)];
+		if (slot == 0) {
+			slot = static_cast<UInt32>(claim(key_of(window))) + 1;
+		}
+		used[slot - 1] = 1;
+		return *models[slot - 1];
+	}
+
+	// Index of a fresh model for key, evicting one when all are in use
+	Size claim(Size key) {
+		Size index;
+		if (model_count < MAX_MODEL_NUM) {
+			index = model_count++;
+			make(index);
+		} else {
+			for (; used[hand] != 0; hand = (hand + 1) % MAX_MODEL_NUM) {
+				used[hand] = 0;
+			}
+			index = hand;
+			hand = (hand + 1) % MAX_MODEL_NUM;
+			slots[keys[index]] = 0;
+		}
+		keys[index] = static_cast<UInt32>(key);
+		models[index]->reset();
+		return index;
+	}
+
+private:
+	ContextBank(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class ContextBank
+
+/*
+ * Weights of symbols trained from a sample of the messages to come. Coders given a dictionary start
+ * every reset from a tree of these weights instead of the lone NYT node, so that the symbols of the
+ * sample cost no escape; each coder builds the tree once and copies it on a reset. Streams carry the
+ * DICTIONARY flag and the id, a hash of the weights, which the decoder checks against its own.
+ * The weights count as symbols already seen, so the heavier they are, the slower the coders follow
+ * a message unlike the sample; scale them down before use.
+ * File layout: magic "AHCD" (4), symbol bit (1), number of symbols (varint), then for each symbol
+ * by increasing value its distance from the one before (varint) and its weight (varint).
+ */
+template<typename symbol_type = Byte>
+class AdaptiveHuffmanDictionary {
+private:
+	using Self = AdaptiveHuffmanDictionary;
+
+public:
+	using Symbol = symbol_type;
+	using InternalSymbol = UInt64;
+	using Weight = std::pair<InternalSymbol, Size>;
+
+	static UInt32 const MAGIC = 0x44434841;
+	static Size const SYMBOL_BIT = BitSize<Symbol>::value;
+	static Size const TOTAL_WEIGHT = 4096; // scale to it unless messages call for more or less
+
+private:
+	std::map<InternalSymbol, Size> counts;
+
+public:
+	AdaptiveHuffmanDictionary() {
+		// do nothing
+	}
+
+	// Count the symbols of a sample
+	void train(Symbol const * first, Symbol const * last) {
+		for (; first != last; ++first) {
+			++counts[static_cast<InternalSymbol>(static_cast<typename Unsigned<Symbol>::Type>(*first))];
+		}
+	}
+
+	// Divide the weights so that they add up to about total_weight, keeping every symbol;
+	// no total at all leaves them as they are
+	void scale(Size total_weight = TOTAL_WEIGHT) {
+		if (total_weight == 0) {
+			return;
+		}
+		Size divisor = (this->total_weight() + total_weight - 1) / total_weight;
+		if (divisor <= 1) {
+			return;
+		}
+		for (auto & count : counts) {
+			count.second = count.second >= divisor ? count.second / divisor : 1;
+		}
+	}
+
+	Size total_weight() const {
+		Size total = 0;
+		for (auto const & count : counts) {
+			total += count.second;
+		}
+		return total;
+	}
+
+	// Symbols and weights, by increasing symbol
+	std::vector<Weight> weights() const {
+		return std::vector<Weight>(counts.begin(), counts.end());
+	}
+
+	// Tree of the weights, with the run escape at weight one for coders that keep it
+	template<typename tree_type>
+	std::unique_ptr<tree_type> make_tree(bool run_escape) const {
+		std::vector<Weight> weights = this->weights();
+		if (run_escape) {
+			InternalSymbol const escape = tree_type::RUN_SYMBOL;
+			weights.emplace_back(escape, 1);
+		}
+		std::unique_ptr<tree_type> tree(new tree_type());
+		tree->prime(weights);
+		return tree;
+	}
+
+	// FNV-1a of the weights, never zero
+	UInt32 id() const {
+		UInt32 hash = 0x811C9DC5;
+		for (auto const & count : counts) {
+			for (UInt64 value : { static_cast<UInt64>(count.first), static_cast<UInt64>(count.second) }) {
+				for (Size i = 0; i < ByteSize<UInt64>::value; ++i) {
+					hash = (hash ^ static_cast<Byte>(value >> (i * BIT_PER_BYTE))) * 0x01000193;
+				}
+			}
+		}
+		return hash != 0 ? hash : 1;
+	}
+
+	void put(typename IO<Byte>::OStream & ostream) const {
+		put_integer(ostream, MAGIC, ByteSize<UInt32>::value);
+		Byte const symbol_bit = static_cast<Byte>(SYMBOL_BIT);
+		ostream.write(&symbol_bit, 1);
+		put_varint(ostream, counts.size());
+		InternalSymbol previous = 0;
+		for (auto const & count : counts) {
+			put_varint(ostream, count.first - previous);
+			put_varint(ostream, count.second);
+			previous = count.first;
+		}
+	}
+
+	// Read a dictionary put by put, false if the input is not one for these symbols
+	bool get(typename IO<Byte>::IStream & istream) {
+		counts.clear();
+		UInt32 magic;
+		Byte symbol_bit;
+		UInt64 size;
+		if (!get_integer(istream, magic, ByteSize<UInt32>::value) || magic != MAGIC || !istream.read(&symbol_bit, 1) || symbol_bit != SYMBOL_BIT || !get_varint(istream, size)) {
+			return false;
+		}
+		InternalSymbol symbol = 0;
+		for (UInt64 i = 0; i < size; ++i) {
+			UInt64 distance, weight;
+			if (!get_varint(istream, distance) || !get_varint(istream, weight) || (i > 0 && distance == 0) || weight == 0) {
+				return false;
+			}
+			symbol += distance;
+			if (SYMBOL_BIT < BitSize<UInt64>::value && (symbol >> (SYMBOL_BIT % BitSize<UInt64>::value)) != 0) {
+				return false;
+			}
+			counts.emplace_hint(counts.end(), symbol, weight);
+		}
+		return true;
+	}
+
+	// Write the dictionary to a file, false if it cannot be written
+	bool save(char const * file_name) const {
+		FileBuffer<Byte> buffer(file_name);
+		typename IO<Byte>::OStream ostream(&buffer);
+		put(ostream);
+		return buffer.is_open() && ostream.flush().good();
+	}
+
+	// Read the dictionary of a file, false if it cannot be read or is not one
+	bool load(char const * file_name) {
+		MappedFile input(file_name);
+		MemoryBuffer<Byte> buffer(input.data(), input.data() + input.size());
+		typename IO<Byte>::IStream istream(&buffer);
+		return input.is_open() && get(istream);
+	}
+}; // class AdaptiveHuffmanDictionary
+
+template<typename symbol_type = Byte, Size rescale_bit = 0, typename update_type = FGKUpdate, bool run_escape = false, typename context_type = NoContext>
+class AdaptiveHuffmanEncoder : public Encoder<symbol_type, AdaptiveHuffmanEncoder<symbol_type, rescale_bit, update_type, run_escape, context_type>> {
+private:
+	using Self = AdaptiveHuffmanEncoder;
+
+public:
+	using Symbol = symbol_type;
+
+	using Base = Encoder<Symbol, Self>;
+
+	friend Base;
+
+	static Size const RESCALE_BIT = rescale_bit;
+	static Byte const MODEL = update_type::MODEL;
+	static bool const RUN_ESCAPE = run_escape;
+	static Byte const FLAGS = RUN_ESCAPE ? StreamHeader::RUN : 0;
+	static Size const CONTEXT_ORDER = context_type::ORDER;
+	static Size const CONTEXT_BIT = context_type::CONTEXT_BIT;
+	static Size const TREE_BIT = context_type::TREE_BIT;
+
+	using Dictionary = AdaptiveHuffmanDictionary<Symbol>;
+
+private:
+	using Tree = typename update_type::template Tree<Symbol, RESCALE_BIT>;
+	using RunTree = typename update_type::template Tree<Byte, RESCALE_BIT>;
+	using Runs = AdaptiveHuffmanRuns;
+
+	struct Model {
+		using Source = Tree const *;
+
+		Tree const * primed; /* where a reset starts from, null for the lone NYT */
+		Tree tree;
+
+		explicit Model(Source primed) : primed(primed) {
+			// do nothing
+		}
+
+		void reset() {
+			if (primed != nullptr) {
+				tree.assign(*primed);
+				return;
+			}
+			tree.reset();
+			if (RUN_ESCAPE) {
+				tree << Tree::RUN_SYMBOL;
+			}
+		}
+
+		void assign(Model const & other) {
+			tree.assign(other.tree);
+		}
+
+		void put(typename IO<Byte>::OStream & ostream) const {
+			tree.put(ostream);
+		}
+
+		bool get(typename IO<Byte>::IStream & istream) {
+			return tree.get(istream);
+		}
+	};
+
+	using Bank = ContextBank<Model, BitSize<Symbol>::value, context_type>;
+
+	std::unique_ptr<Tree> primed; /* tree of the dictionary, null without one */
+	Bank bank;
+	Model * model; /* of the current context */
+	std::vector<UInt64> spill; /* deeper words of codes longer than 64 bits */
+	std::unique_ptr<RunTree> runs; /* bit lengths of run lengths, null without run_escape */
+	Symbol previous; /* the last symbol coded */
+	Size repeat_count; /* repeats of previous held back */
+
+public:
+	AdaptiveHuffmanEncoder(typename Base::OStream & os, Size frame_size = Base::FRAME_SIZE, Byte flags = 0) : Base(os, frame_size, flags), bank(nullptr), runs(make_runs()) {
+		reset();
+	}
+
+	// Start from the weights of dictionary, which the decoder has to hold too
+	AdaptiveHuffmanEncoder(typename Base::OStream & os, Dictionary const & dictionary, Size frame_size = Base::FRAME_SIZE, Byte flags = 0) :
+		Base(os, frame_size, flags, dictionary.id()),
+		primed(dictionary.template make_tree<Tree>(RUN_ESCAPE)),
+		bank(primed.get()),
+		runs(make_runs()) {
+		reset();
+	}
+
+	AdaptiveHuffmanEncoder() : Base(), bank(nullptr), runs(make_runs()) {
+		reset();
+	}
+
+	explicit AdaptiveHuffmanEncoder(Dictionary const & dictionary) : Base(dictionary.id()), primed(dictionary.template make_tree<Tree>(RUN_ESCAPE)), bank(primed.get()), runs(make_runs()) {
+		reset();
+	}
+
+	~AdaptiveHuffmanEncoder() {
+		if (Base::ostream != nullptr) {
+			put_repeats();
+		}
+	}
+
+	void reset() {
+		model = &bank.reset();
+		if (RUN_ESCAPE) {
+			runs->reset();
+		}
+		previous = Symbol();
+		repeat_count = 0;
+	}
+
+	// Take on the model of other, a coder of the same type and dictionary: the trees of its contexts,
+	// and the last symbols; repeats other holds back stay with it. A model warmed up on one stream
+	// so codes the next, or a message on each of several threads
+	void assign_model(Self const & other) {
+		model = &bank.assign(other.bank);
+		if (RUN_ESCAPE) {
+			runs->assign(*other.runs);
+		}
+		previous = other.previous;
+		repeat_count = 0;
+	}
+
+	/*
+	 * Write the model assign_model takes on, for get_model to read back, in another process even.
+	 * Taken between two frames, where the encoder holds nothing back, it is the model the decoder
+	 * of the stream has there, so either can go on with the stream from it, as from a fresh model.
+	 * Layout: the stream header of the coder, the last symbol (varint), the tree of run lengths with
+	 * run_escape, then the contexts, see ContextBank::put, and trees, see AdaptiveHuffmanTree::put.
+	 */
+	void put_model(typename IO<Byte>::OStream & ostream) const {
+		Base::header.put(ostream);
+		put_varint(ostream, Tree::to_internal(previous));
+		if (RUN_ESCAPE) {
+			runs->put(ostream);
+		}
+		bank.put(ostream);
+	}
+
+	// Take on a model written by put_model of a coder of the same type and dictionary, false and reset if the input is not one
+	bool get_model(typename IO<Byte>::IStream & istream) {
+		StreamHeader header;
+		UInt64 symbol;
+		if (!header.get(istream) || !header.is_coded_as(Base::header) || !get_varint(istream, symbol) || symbol != Tree::to_internal(Tree::to_external(symbol))
+			|| (RUN_ESCAPE && !runs->get(istream)) || !bank.get(istream)) {
+			reset();
+			return false;
+		}
+		model = &bank.current();
+		previous = Tree::to_external(symbol);
+		repeat_count = 0;
+		return true;
+	}
+
+	Size take_frame(Byte * output, Size capacity) {
+		put_repeats();
+		return Base::take_frame(output, capacity);
+	}
+
+	Size take_frame(std::vector<Byte> & payload) {
+		put_repeats();
+		return Base::take_frame(payload);
+	}
+
+	// Most bytes a frame of count symbols can take
+	static Size bound(Size count) {
+		return primed_bound(count, 0);
+	}
+
+	// Most bytes a frame of count symbols can take, coded from dictionary
+	static Size bound(Size count, Dictionary const & dictionary) {
+		return primed_bound(count, dictionary.total_weight() + 1);
+	}
+
+protected:
+	Size put_run(Symbol const * first, Symbol const * last, Size byte_limit) {
+		if (RUN_ESCAPE && Base::ostream != nullptr && static_cast<Size>(last - first) > Runs::MAX_FRAME_COUNT - Base::frame_count) {
+			last = first + (Runs::MAX_FRAME_COUNT - Base::frame_count);
+		}
+		Symbol const * cursor = first;
+		for (; cursor != last && Base::writer.byte_count() < byte_limit; ++cursor) {
+			if (RUN_ESCAPE) {
+				if (*cursor == previous) {
+					if (++repeat_count == Runs::MAX_LENGTH) {
+						put_repeats();
+					}
+					continue;
+				}
+				put_repeats();
+				previous = *cursor;
+			}
+			put_symbol(*cursor);
+			model->tree << *cursor;
+			model = &bank.next(Tree::to_internal(*cursor));
+		}
+		return cursor - first;
+	}
+
+	// A run ends with its frame
+	void put_frame() {
+		put_repeats();
+		Base::put_frame();
+	}
+
+private:
+	static RunTree * make_runs() {
+		return RUN_ESCAPE ? new RunTree() : nullptr;
+	}
+
+	// Most bytes a frame of count symbols can take, from a tree that starts at primed_weight
+	static Size primed_bound(Size count, Size primed_weight) {
+		// A tree of total weight w is at most d deep for the largest d with F(d + 1) <= w,
+		// F being the Fibonacci numbers; the zero weight NYT node accounts for the + 1
+		Size depth = 0;
+		for (Size f1 = 1, f2 = 1; f2 <= count + primed_weight && depth < Tree::MAX_CODE_LENGTH; ++depth) {
+			Size f3 = f1 + f2;
+			f1 = f2;
+			f2 = f3;
+		}
+		// Each context sends its own symbols the first time
+		Size distinct = count < Tree::SYMBOL_NUM || Bank::ORDER != 0 ? count : Tree::SYMBOL_NUM;
+		Size bits = count * depth + distinct * Base::SYMBOL_BIT;
+		if (RUN_ESCAPE) {
+			// The escape leaf takes a weight of one, so a depth of one more; each escape, which
+			// stands for MIN_LENGTH symbols at least, may cost more than they would one by one
+			bits += count + count / Runs::MIN_LENGTH * (2 * Runs::LENGTH_BIT + BIT_PER_BYTE);
+		}
+		return (bits + BIT_PER_BYTE - 1) / BIT_PER_BYTE;
+	}
+
+	// Put the repeats held back, as a run escape if there are enough of them
+	void put_repeats() {
+		if (repeat_count < Runs::MIN_LENGTH) {
+			for (; repeat_count > 0; --repeat_count) {
+				put_symbol(previous);
+				model->tree << previous;
+				model = &bank.next(Tree::to_internal(previous));
+			}
+			return;
+		}
+		encode_and_put(model->tree[Tree::RUN_SYMBOL]);
+		model->tree << Tree::RUN_SYMBOL;
+		UInt64 value = repeat_count - Runs::MIN_LENGTH + 1;
+		Byte n = 0;
+		for (; (value >> n) > 1; ++n) {
+			// do nothing
+		}
+		auto cursor = (*runs)[n];
+		if (cursor.is_null()) {
+			encode_and_put<RunTree>(runs->nyt());
+			Base::put_bits(n, BIT_PER_BYTE);
+		} else {
+			encode_and_put<RunTree>(cursor);
+		}
+		*runs << n;
+		Base::put_bits(value & low_mask(n), n);
+		model = &bank.next(Tree::to_internal(previous), repeat_count);
+		repeat_count = 0;
+	}
+
+	// Send a symbol
+	void put_symbol(Symbol symbol) {
+		auto cursor = model->tree[symbol];
+		if (cursor.is_null()) {
+			// Symbol hasn't been transmitted in this context, send a NYT, then the symbol
+			encode_and_put(model->tree.nyt());
+			Base::put_plain(symbol);
+		} else {
+			encode_and_put(cursor);
+		}
+	}
+
+	// Encode symbol and send code
+	template<typename tree_type = Tree>
+	void encode_and_put(typename tree_type::Cursor cursor) {
+		// Collect the path from leaf to root, the bit next to the root ends up lowest
+		UInt64 code = 0;
+		Size length = 0;
+		if (tree_type::MAX_CODE_LENGTH <= BitSize<UInt64>::value) {
+			// A bounded tree's code always fits one word
+			for (; !cursor.is_root(); cursor.up()) {
+				code <<= cursor.side();
+				++length;
+			}
+			Base::put_bits(code, length);
+			return;
+		}
+		for (; !cursor.is_root(); cursor.up()) {
+			if (length == BitSize<UInt64>::value) {
+				spill.push_back(code);
+				code = 0;
+				length = 0;
+			}
+			code <<= cursor.side();
+			++length;
+		}
+		Base::put_bits(code, length);
+		for (; !spill.empty(); spill.pop_back()) {
+			Base::put_bits(spill.back(), BitSize<UInt64>::value);
+		}
+	}
+
+private:
+	AdaptiveHuffmanEncoder(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class AdaptiveHuffmanEncoder
+
+template<typename symbol_type = Byte, Size rescale_bit = 0, typename update_type = FGKUpdate, bool run_escape = false, typename context_type = NoContext>
+class AdaptiveHuffmanDecoder : public Decoder<symbol_type, AdaptiveHuffmanDecoder<symbol_type, rescale_bit, update_type, run_escape, context_type>> {
+private:
+	using Self = AdaptiveHuffmanDecoder;
+
+public:
+	using Symbol = symbol_type;
+
+	using Base = Decoder<Symbol, Self>;
+
+	friend Base;
+
+	static Size const RESCALE_BIT = rescale_bit;
+	static Byte const MODEL = update_type::MODEL;
+	static bool const RUN_ESCAPE = run_escape;
+	static Byte const FLAGS = RUN_ESCAPE ? StreamHeader::RUN : 0;
+	static Size const CONTEXT_ORDER = context_type::ORDER;
+	static Size const CONTEXT_BIT = context_type::CONTEXT_BIT;
+	static Size const TREE_BIT = context_type::TREE_BIT;
+
+	using Dictionary = AdaptiveHuffmanDictionary<Symbol>;
+
+private:
+	using Tree = typename update_type::template Tree<Symbol, RESCALE_BIT>;
+	using Lookup = AdaptiveHuffmanLookup<Tree>;
+	using RunTree = typename update_type::template Tree<Byte, RESCALE_BIT>;
+	using Runs = AdaptiveHuffmanRuns;
+
+	// Small rescale limits keep weights small and tied, so the tree reshapes on most updates and
+	// patching the table costs more than it saves; those trees are shallow, and walked from a single look
+	static bool const USE_LOOKUP = RESCALE_BIT == 0 || RESCALE_BIT >= 20;
+	static_assert(USE_LOOKUP || Tree::MAX_CODE_LENGTH <= BitReader::MAX_PEEK_BIT, "trees without lookup must be bounded");
+
+	// Deepest codes of trees whose weights count the symbols of any stream, below 1 << 63 of them
+	static Size const WEIGHT_DEPTH = rescaled_code_length(static_cast<Size>(1) << 63);
+	static Size const MAX_DEPTH = Tree::MAX_CODE_LENGTH < WEIGHT_DEPTH ? Tree::MAX_CODE_LENGTH : WEIGHT_DEPTH;
+	static Size const MAX_RUN_DEPTH = RunTree::MAX_CODE_LENGTH < WEIGHT_DEPTH ? RunTree::MAX_CODE_LENGTH : WEIGHT_DEPTH;
+
+	struct Model {
+		using Source = Tree const *;
+
+		Tree const * primed; /* where a reset starts from, null for the lone NYT */
+		Tree tree;
+		Lookup lookup;
+
+		explicit Model(Source primed) : primed(primed), lookup(tree) {
+			// do nothing
+		}
+
+		void reset() {
+			lookup.reset();
+			if (primed != nullptr) {
+				tree.assign(*primed);
+				return;
+			}
+			tree.reset();
+			if (RUN_ESCAPE) {
+				tree << Tree::RUN_SYMBOL;
+			}
+		}
+
+		// The lookup is built again once the tree has seen enough updates
+		void assign(Model const & other) {
+			lookup.reset();
+			tree.assign(other.tree);
+		}
+
+		void put(typename IO<Byte>::OStream & ostream) const {
+			tree.put(ostream);
+		}
+
+		bool get(typename IO<Byte>::IStream & istream) {
+			lookup.reset();
+			return tree.get(istream);
+		}
+	};
+
+	using Bank = ContextBank<Model, BitSize<Symbol>::value, context_type>;
+
+	std::unique_ptr<Tree> primed; /* tree of the dictionary, null without one */
+	Bank bank;
+	Model * model; /* of the current context */
+	std::unique_ptr<RunTree> runs; /* bit lengths of run lengths, null without run_escape */
+	Symbol previous; /* the last symbol got */
+	Size repeat_count; /* repeats of previous still to give out */
+
+public:
+	AdaptiveHuffmanDecoder(typename Base::IStream & is) : Base(is), bank(nullptr), runs(make_runs()) {
+		Base::check_model();
+		reset();
+	}
+
+	AdaptiveHuffmanDecoder(typename Base::IStream & is, StreamHeader const & header) : Base(is, header), bank(nullptr), runs(make_runs()) {
+		Base::check_model();
+		reset();
+	}
+
+	// Start from the weights of dictionary, which has to be the one the stream was coded from
+	AdaptiveHuffmanDecoder(typename Base::IStream & is, Dictionary const & dictionary) : Base(is), primed(dictionary.template make_tree<Tree>(RUN_ESCAPE)), bank(primed.get()), runs(make_runs()) {
+		Base::check_model(dictionary.id());
+		reset();
+	}
+
+	AdaptiveHuffmanDecoder(typename Base::IStream & is, StreamHeader const & header, Dictionary const & dictionary) :
+		Base(is, header),
+		primed(dictionary.template make_tree<Tree>(RUN_ESCAPE)),
+		bank(primed.get()),
+		runs(make_runs()) {
+		Base::check_model(dictionary.id());
+		reset();
+	}
+
+	AdaptiveHuffmanDecoder() : Base(), bank(nullptr), runs(make_runs()) {
+		reset();
+	}
+
+	explicit AdaptiveHuffmanDecoder(Dictionary const & dictionary) : Base(dictionary.id()), primed(dictionary.template make_tree<Tree>(RUN_ESCAPE)), bank(primed.get()), runs(make_runs()) {
+		reset();
+	}
+
+	void reset() {
+		model = &bank.reset();
+		if (RUN_ESCAPE) {
+			runs->reset();
+		}
+		previous = Symbol();
+		repeat_count = 0;
+	}
+
+	// Most bytes a frame of count symbols can take, from a tree of any weight the stream may have built
+	static Size payload_bound(Size count) {
+		Size bits = count * (MAX_DEPTH + Base::SYMBOL_BIT);
+		if (RUN_ESCAPE) {
+			// The escape leaf deepens the tree by one; each escape stands for MIN_LENGTH symbols at least
+			bits += count + count / Runs::MIN_LENGTH * (MAX_RUN_DEPTH + BIT_PER_BYTE + Runs::LENGTH_BIT);
+		}
+		return (bits + BIT_PER_BYTE - 1) / BIT_PER_BYTE;
+	}
+
+	// Take on the model of other, as AdaptiveHuffmanEncoder::assign_model does; repeats other has still to give out stay with it
+	void assign_model(Self const & other) {
+		model = &bank.assign(other.bank);
+		if (RUN_ESCAPE) {
+			runs->assign(*other.runs);
+		}
+		previous = other.previous;
+		repeat_count = 0;
+	}
+
+	// Write the model, as AdaptiveHuffmanEncoder::put_model does
+	void put_model(typename IO<Byte>::OStream & ostream) const {
+		Base::header.put(ostream);
+		put_varint(ostream, Tree::to_internal(previous));
+		if (RUN_ESCAPE) {
+			runs->put(ostream);
+		}
+		bank.put(ostream);
+	}
+
+	// Take on a model written by put_model of either coder of this type and dictionary, false and reset if the input is not one;
+	// taken between two frames, the decoder goes on with the frames after them, see Decoder(IStream &, StreamHeader const &)
+	bool get_model(typename IO<Byte>::IStream & istream) {
+		StreamHeader header;
+		UInt64 symbol;
+		if (!header.get(istream) || !header.is_coded_as(Base::header) || !get_varint(istream, symbol) || symbol != Tree::to_internal(Tree::to_external(symbol))
+			|| (RUN_ESCAPE && !runs->get(istream)) || !bank.get(istream)) {
+			reset();
+			return false;
+		}
+		model = &bank.current();
+		previous = Tree::to_external(symbol);
+		repeat_count = 0;
+		return true;
+	}
+
+protected:
+	void get_run(Symbol * output, Size count) {
+		for (Size i = 0; i < count; ) {
+			if (RUN_ESCAPE && repeat_count > 0) {
+				Size n = repeat_count < count - i ? repeat_count : count - i;
+				std::fill(output + i, output + i + n, previous);
+				repeat_count -= n;
+				i += n;
+				continue;
+			}
+			auto symbol = get_symbol();
+			model->tree << symbol;
+			if (USE_LOOKUP) {
+				model->lookup.update();
+			}
+			if (RUN_ESCAPE) {
+				if (symbol == Tree::RUN_SYMBOL) {
+					repeat_count = get_run_length();
+					model = &bank.next(Tree::to_internal(previous), repeat_count);
+					continue;
+				}
+				previous = Tree::to_external(symbol);
+			}
+			output[i++] = Tree::to_external(symbol);
+			model = &bank.next(symbol);
+		}
+	}
+
+private:
+	static RunTree * make_runs() {
+		return RUN_ESCAPE ? new RunTree() : nullptr;
+	}
+
+	// Get the length of a run, after its escape; runs are rare, so the run tree is walked a bit at a time
+	Size get_run_length() {
+		auto cursor = runs->root();
+		while (cursor.symbol() == RunTree::INTERNAL) {
+			cursor.down(Base::get_bit());
+		}
+		Byte n = cursor.symbol() == RunTree::NYT_SYMBOL ? static_cast<Byte>(Base::reader.get_bits(BIT_PER_BYTE)) : RunTree::to_external(cursor.symbol());
+		*runs << n;
+		if (n >= Runs::LENGTH_BIT) {
+			n = Runs::LENGTH_BIT - 1; // malformed input
+		}
+		UInt64 value = (static_cast<UInt64>(1) << n) | Base::reader.get_bits(n);
+		return value + Runs::MIN_LENGTH - 1;
+	}
+
+	// Get a symbol, the run escape included
+	typename Tree::InternalSymbol get_symbol() {
+		if (Tree::MAX_CODE_LENGTH <= BitReader::MAX_PEEK_BIT) {
+			return get_bounded_symbol();
+		}
+		auto cursor = model->tree.root();
+		if (model->lookup.is_active()) {
+			// Resolve the first bits at once, walk on only for longer codes
+			auto const & entry = model->lookup[static_cast<UInt32>(Base::peek_bits(Lookup::LOOKUP_BIT))];
+			Base::skip_bits(entry.length);
+			cursor = model->lookup.cursor(entry);
+		}
+		for (; !cursor.is_null() && cursor.symbol() == Tree::INTERNAL; ) {
+			cursor.down(Base::get_bit());
+		}
+		if (cursor.symbol() == Tree::NYT_SYMBOL) {
+			return Tree::to_internal(Base::get_plain());
+		} else {
+			return cursor.symbol();
+		}
+	}
+
+	// Get a symbol of a bounded tree, all of its code comes from a single look at the input
+	typename Tree::InternalSymbol get_bounded_symbol() {
+		UInt64 bits = Base::peek_bits(Tree::MAX_CODE_LENGTH);
+		auto cursor = model->tree.root();
+		Size length = 0;
+		if (model->lookup.is_active()) {
+			auto const & entry = model->lookup[static_cast<UInt32>(bits & low_mask(Lookup::LOOKUP_BIT))];
+			cursor = model->lookup.cursor(entry);
+			length = entry.length;
+		}
+		for (; !cursor.is_null() && cursor.symbol() == Tree::INTERNAL; ++length) {
+			cursor.down(static_cast<Bit>((bits >> length) & 1));
+		}
+		Base::skip_bits(length);
+		if (cursor.symbol() == Tree::NYT_SYMBOL) {
+			return Tree::to_internal(Base::get_plain());
+		} else {
+			return cursor.symbol();
+		}
+	}
+
+private:
+	AdaptiveHuffmanDecoder(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class AdaptiveHuffmanDecoder
+
+// Weights are rescaled as described at AdaptiveHuffmanTree, with the same rescale_bit on both sides;
+// update_type is FGKUpdate or VitterUpdate; run_escape codes runs of a symbol as described at AdaptiveHuffmanRuns;
+// context_type is NoContext or a SymbolContext, which picks the tree by the last symbols
+template<typename symbol_type = Byte, Size rescale_bit = 0, typename update_type = FGKUpdate, bool run_escape = false, typename context_type = NoContext>
+class AdaptiveHuffmanCodec : public Codec<symbol_type, AdaptiveHuffmanEncoder<symbol_type, rescale_bit, update_type, run_escape, context_type>, AdaptiveHuffmanDecoder<symbol_type, rescale_bit, update_type, run_escape, context_type>> {
+private:
+	using Self = AdaptiveHuffmanCodec;
+
+public:
+	using Symbol = symbol_type;
+
+	using Encoder = AdaptiveHuffmanEncoder<Symbol, rescale_bit, update_type, run_escape, context_type>;
+	using Decoder = AdaptiveHuffmanDecoder<Symbol, rescale_bit, update_type, run_escape, context_type>;
+
+	using Base = Codec<Symbol, Encoder, Decoder>;
+
+}; // class AdaptiveHuffmanCodec
+
+// Codes are never longer than max_code_length bits, the tree rescales its weights to keep them so;
+// rescaling has to leave room for the whole alphabet, so the cap is min_code_length of the symbol bits at least
+template<typename symbol_type, Size max_code_length, typename update_type = FGKUpdate, bool run_escape = false, typename context_type = NoContext>
+using LengthLimitedAdaptiveHuffmanCodec = AdaptiveHuffmanCodec<symbol_type, CodeLengthLimit<BitSize<symbol_type>::value, max_code_length>::RESCALE_BIT, update_type, run_escape, context_type>;
 
 #endif // __ADAPTIVE_HUFFMAN_CODEC_HPP__
@@ -0,0 +1,671 @@
+#include "adaptive_huffman_codec.hpp"
+#include "static_huffman_codec.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Throughput and ratio of the adaptive and static codecs on synthetic corpora.
+ * Every corpus comes from a fixed seed, so runs on the same build are comparable.
+ * One JSON object per line goes to stdout, one per codec and corpus.
+ */
+
+static std::atomic<Size> allocation_count(0);
+
+// Every form of the global operator new counts and takes its memory from malloc, and every
+// form of operator delete gives it back to free, so that no pairing mixes the two families
+static void * allocate(std::size_t size) {
+	++allocation_count;
+	if (void * memory = std::malloc(size == 0 ? 1 : size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void * operator new(std::size_t size) {
+	return allocate(size);
+}
+
+void * operator new[](std::size_t size) {
+	return allocate(size);
+}
+
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept {
+	try {
+		return allocate(size);
+	} catch (std::bad_alloc const &) {
+		return nullptr;
+	}
+}
+
+void * operator new[](std::size_t size, std::nothrow_t const &) noexcept {
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void * memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void * memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void * memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void * memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void * memory, std::nothrow_t const &) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void * memory, std::nothrow_t const &) noexcept {
+	std::free(memory);
+}
+
+#if defined(__cpp_aligned_new)
+// aligned_alloc takes sizes in whole multiples of the alignment
+static void * allocate(std::size_t size, std::align_val_t alignment) {
+	++allocation_count;
+	std::size_t align = static_cast<std::size_t>(alignment);
+	std::size_t rounded = size == 0 ? align : (size + align - 1) / align * align;
+	if (void * memory = std::aligned_alloc(align, rounded)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment) {
+	return allocate(size, alignment);
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment) {
+	return allocate(size, alignment);
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept {
+	try {
+		return allocate(size, alignment);
+	} catch (std::bad_alloc const &) {
+		return nullptr;
+	}
+}
+
+void * operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept {
+	return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void * memory, std::align_val_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void * memory, std::align_val_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void * memory, std::size_t, std::align_val_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void * memory, std::size_t, std::align_val_t) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void * memory, std::align_val_t, std::nothrow_t const &) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void * memory, std::align_val_t, std::nothrow_t const &) noexcept {
+	std::free(memory);
+}
+#endif
+
+static UInt64 const SEED = 0x5EED;
+static Size const TINY_SIZE = 64; // symbols per tiny message
+static Size const RANGE_SIZE = 1024 * 1024; // symbols of the range checks at least, enough for a few sync points
+static Size const RANGE_NUM = 16; // ranges checked per stream
+
+void usage() {
+	std::cerr
+		<< "Usage:\n"
+		<< "benchmark [symbols] [repetitions]\n";
+}
+
+// Draw ranks below n with probability proportional to 1 / (rank + 1) ^ s
+class ZipfDistribution {
+private:
+	std::vector<double> cumulative;
+
+public:
+	ZipfDistribution(Size n, double s) : cumulative(n) {
+		double sum = 0;
+		for (Size i = 0; i < n; ++i) {
+			cumulative[i] = sum += 1 / std::pow(static_cast<double>(i + 1), s);
+		}
+	}
+
+	template<typename engine_type>
+	Size operator()(engine_type & engine) {
+		double x = std::uniform_real_distribution<double>(0, cumulative.back())(engine);
+		Size rank = std::lower_bound(cumulative.begin(), cumulative.end(), x) - cumulative.begin();
+		return rank < cumulative.size() ? rank : cumulative.size() - 1;
+	}
+};
+
+template<typename symbol_type>
+struct Corpora {
+	using Symbol = symbol_type;
+	using Symbols = std::vector<Symbol>;
+
+	static Size alphabet() {
+		Size num = AdaptiveHuffmanCodec<Symbol>::SYMBOL_NUM;
+		return num < 0x10000 ? num : 0x10000;
+	}
+
+	static Symbols uniform(Size size) {
+		std::mt19937_64 engine(SEED);
+		Symbols symbols(size);
+		for (auto & symbol : symbols) {
+			symbol = static_cast<Symbol>(engine() % alphabet());
+		}
+		return symbols;
+	}
+
+	static Symbols skewed(Size size) {
+		std::mt19937_64 engine(SEED + 1);
+		ZipfDistribution zipf(alphabet() < 4096 ? alphabet() : 4096, 1.1);
+		Symbols symbols(size);
+		for (auto & symbol : symbols) {
+			symbol = static_cast<Symbol>(zipf(engine));
+		}
+		return symbols;
+	}
+
+	// Words of a made up vocabulary with Zipf frequencies, wide symbols get some non-ASCII letters
+	static Symbols text(Size size) {
+		std::mt19937_64 engine(SEED + 2);
+		std::vector<Symbols> words(2000);
+		for (auto & word : words) {
+			Size length = 1 + engine() % 4 + engine() % 5;
+			for (Size i = 0; i < length; ++i) {
+				Size letter = engine() % 26;
+				if (sizeof(Symbol) > 1 && engine() % 16 == 0) {
+					word.push_back(static_cast<Symbol>(0x430 + letter));
+				} else {
+					word.push_back(static_cast<Symbol>('a' + letter));
+				}
+			}
+		}
+		ZipfDistribution zipf(words.size(), 1.0);
+		Symbols symbols;
+		symbols.reserve(size + 16);
+		while (symbols.size() < size) {
+			auto const & word = words[zipf(engine)];
+			symbols.insert(symbols.end(), word.begin(), word.end());
+			symbols.push_back(static_cast<Symbol>(engine() % 12 == 0 ? (engine() % 2 == 0 ? '.' : '\n') : ' '));
+		}
+		symbols.resize(size);
+		return symbols;
+	}
+
+	// Skewed symbols whose ranking is reshuffled every segment, as in logs that change subject
+	static Symbols drifting(Size size) {
+		std::mt19937_64 engine(SEED + 3);
+		Size num = alphabet() < 4096 ? alphabet() : 4096;
+		ZipfDistribution zipf(num, 1.1);
+		std::vector<Symbol> ranking(num);
+		for (Size i = 0; i < num; ++i) {
+			ranking[i] = static_cast<Symbol>(i);
+		}
+		Symbols symbols(size);
+		for (Size i = 0; i < size; ++i) {
+			if (i % (64 * 1024) == 0) {
+				std::shuffle(ranking.begin(), ranking.end(), engine);
+			}
+			symbols[i] = ranking[zipf(engine)];
+		}
+		return symbols;
+	}
+
+	// Long runs of all zero and all one symbols between short bursts of small values, as in sparse telemetry
+	static Symbols sparse(Size size) {
+		std::mt19937_64 engine(SEED + 4);
+		Symbols symbols;
+		symbols.reserve(size + 4096);
+		while (symbols.size() < size) {
+			Size kind = engine() % 8;
+			if (kind < 5) {
+				symbols.insert(symbols.end(), 1 + engine() % 4096, static_cast<Symbol>(kind < 3 ? 0 : alphabet() - 1));
+			} else {
+				for (Size i = engine() % 32; i > 0; --i) {
+					symbols.push_back(static_cast<Symbol>(engine() % 64));
+				}
+			}
+		}
+		symbols.resize(size);
+		return symbols;
+	}
+
+	// The coded form of the text corpus, read as symbols
+	static Symbols compressed(Size size) {
+		auto plain = Corpora<Byte>::text(size * sizeof(Symbol) * 2);
+		std::vector<Byte> coded(AdaptiveHuffmanCodec<Byte>::bound(plain.size()));
+		coded.resize(AdaptiveHuffmanCodec<Byte>::encode(plain.data(), plain.size(), coded.data(), coded.size()));
+		coded.resize(size * sizeof(Symbol) < coded.size() ? size * sizeof(Symbol) : coded.size() / sizeof(Symbol) * sizeof(Symbol));
+		Symbols symbols(coded.size() / sizeof(Symbol));
+		std::copy(coded.begin(), coded.end(), reinterpret_cast<Byte *>(symbols.data()));
+		return symbols;
+	}
+};
+
+struct Measure {
+	double seconds;
+	Size allocations;
+};
+
+// Best of repetitions runs of task
+template<typename task_type>
+Measure measure(Size repetitions, task_type task) {
+	Measure best = { 0, 0 };
+	for (Size i = 0; i < repetitions; ++i) {
+		Size allocations = allocation_count;
+		auto start = std::chrono::steady_clock::now();
+		task();
+		auto stop = std::chrono::steady_clock::now();
+		double seconds = std::chrono::duration<double>(stop - start).count();
+		if (i == 0 || seconds < best.seconds) {
+			best = { seconds, allocation_count - allocations };
+		}
+	}
+	return best;
+}
+
+void report(char const * codec, char const * corpus, Size symbol_num, Size input_size, Size output_size, bool verified, Measure encode, Measure decode) {
+	double megabytes = input_size / 1e6;
+	std::cout
+		<< "{\"codec\":\"" << codec << "\""
+		<< ",\"corpus\":\"" << corpus << "\""
+		<< ",\"symbols\":" << symbol_num
+		<< ",\"input_bytes\":" << input_size
+		<< ",\"output_bytes\":" << output_size
+		<< ",\"ratio\":" << (output_size == 0 ? 0 : static_cast<double>(input_size) / output_size)
+		<< ",\"encode_mb_per_s\":" << megabytes / encode.seconds
+		<< ",\"decode_mb_per_s\":" << megabytes / decode.seconds
+		<< ",\"encode_ns_per_symbol\":" << encode.seconds * 1e9 / symbol_num
+		<< ",\"decode_ns_per_symbol\":" << decode.seconds * 1e9 / symbol_num
+		<< ",\"encode_allocations_per_symbol\":" << static_cast<double>(encode.allocations) / symbol_num
+		<< ",\"decode_allocations_per_symbol\":" << static_cast<double>(decode.allocations) / symbol_num
+		<< ",\"verified\":" << (verified ? "true" : "false")
+		<< "}" << std::endl;
+}
+
+// Whole corpus through the stream interface, flags go to the stream header
+template<typename codec_type>
+bool run_stream(char const * codec, char const * corpus, std::vector<typename codec_type::Symbol> const & symbols, Size repetitions, StreamHeader::Flags flags = StreamHeader::Flags()) {
+	using Codec = codec_type;
+	using symbol_type = typename Codec::Symbol;
+	using Symbols = std::basic_string<symbol_type>;
+
+	Symbols input(symbols.begin(), symbols.end());
+	std::basic_string<Byte> coded;
+	auto encode = measure(repetitions, [&]() {
+		typename IO<symbol_type>::IStringStream istream(input);
+		typename IO<Byte>::OStringStream ostream;
+		Codec::encode(istream, ostream, flags);
+		coded = ostream.str();
+	});
+	Symbols output;
+	auto decode = measure(repetitions, [&]() {
+		typename IO<Byte>::IStringStream istream(coded);
+		typename IO<symbol_type>::OStringStream ostream;
+		Codec::decode(istream, ostream);
+		output = ostream.str();
+	});
+	bool verified = output == input;
+	report(codec, corpus, input.size(), input.size() * sizeof(symbol_type), coded.size(), verified, encode, decode);
+	return verified;
+}
+
+// Corpus cut into tiny messages through the in-memory interface, reusing one context built from args
+template<typename codec_type, typename... Args>
+bool run_tiny(char const * codec, std::vector<typename codec_type::Symbol> const & symbols, Size repetitions, Args const & ... args) {
+	using Codec = codec_type;
+	using symbol_type = typename Codec::Symbol;
+
+	Size message_num = symbols.size() / TINY_SIZE;
+	Size symbol_num = message_num * TINY_SIZE;
+	Size bound = Codec::bound(TINY_SIZE, args...);
+	std::vector<Byte> coded(message_num * bound);
+	std::vector<Size> coded_sizes(message_num);
+	std::vector<symbol_type> output(symbol_num);
+	std::unique_ptr<typename Codec::Context> context(new typename Codec::Context(args...));
+	auto encode = measure(repetitions, [&]() {
+		for (Size i = 0; i < message_num; ++i) {
+			coded_sizes[i] = Codec::encode(symbols.data() + i * TINY_SIZE, TINY_SIZE, coded.data() + i * bound, bound, *context);
+		}
+	});
+	auto decode = measure(repetitions, [&]() {
+		for (Size i = 0; i < message_num; ++i) {
+			Codec::decode(coded.data() + i * bound, coded_sizes[i], output.data() + i * TINY_SIZE, TINY_SIZE, *context);
+		}
+	});
+	Size coded_size = 0;
+	for (Size size : coded_sizes) {
+		coded_size += size;
+	}
+	bool verified = std::equal(output.begin(), output.end(), symbols.begin());
+	report(codec, "tiny", symbol_num, symbol_num * sizeof(symbol_type), coded_size, verified, encode, decode);
+	return verified;
+}
+
+// Edge cases of the interfaces, checked once rather than timed; what fails goes to stderr
+template<typename codec_type>
+bool check(char const * codec, std::vector<typename codec_type::Symbol> const & symbols) {
+	using Codec = codec_type;
+	using symbol_type = typename Codec::Symbol;
+	using Symbols = std::basic_string<symbol_type>;
+
+	bool verified = true;
+	auto expect = [codec, &verified](bool condition, char const * what) {
+		if (!condition) {
+			std::cerr << "benchmark: " << codec << ": " << what << '\n';
+			verified = false;
+		}
+	};
+
+	// No threads at all is taken as one
+	Symbols input(symbols.begin(), symbols.end());
+	typename IO<symbol_type>::IStringStream istream(input);
+	typename IO<Byte>::OStringStream ostream;
+	Codec::encode(istream, ostream, Size(0));
+	typename IO<Byte>::IStringStream coded(ostream.str());
+	typename IO<symbol_type>::OStringStream output;
+	Codec::decode(coded, output, Size(0));
+	expect(!coded.fail() && output.str() == input, "parallel round trip on zero threads");
+
+	// And blocks of no symbols as blocks of one
+	typename IO<symbol_type>::IStringStream tiny_istream(input.substr(0, 100));
+	typename IO<Byte>::OStringStream tiny_ostream;
+	Codec::encode(tiny_istream, tiny_ostream, Size(2), Size(0));
+	typename IO<Byte>::IStringStream tiny_coded(tiny_ostream.str());
+	typename IO<symbol_type>::OStringStream tiny_output;
+	Codec::decode(tiny_coded, tiny_output, Size(2));
+	expect(!tiny_coded.fail() && tiny_output.str() == input.substr(0, 100), "parallel round trip of zero symbol blocks");
+
+	// Messages cut to half their bytes are malformed, not short
+	for (Size count : { Size(2), Size(5), Size(64), Size(1000) }) {
+		count = count < symbols.size() ? count : symbols.size();
+		std::vector<Byte> message(Codec::bound(count));
+		Size size = Codec::encode(symbols.data(), count, message.data(), message.size());
+		std::vector<symbol_type> decoded(count);
+		expect(Codec::decode(message.data(), size / 2, decoded.data(), count) == Codec::ERROR_SIZE, "truncated message");
+	}
+
+	// So is a stream whose first frame lost half its payload, its size halved along
+	std::basic_string<Byte> stream = ostream.str();
+	typename IO<Byte>::OStringStream header;
+	StreamHeader::of<typename Codec::Encoder>(StreamHeader::INDEPENDENT).put(header);
+	Size header_size = header.str().size();
+	UInt32 payload_size = 0;
+	for (Size i = 0; i < ByteSize<UInt32>::value; ++i) {
+		payload_size |= static_cast<UInt32>(stream[header_size + i]) << (i * BIT_PER_BYTE);
+	}
+	for (Size i = 0; i < ByteSize<UInt32>::value; ++i) {
+		stream[header_size + i] = static_cast<Byte>((payload_size / 2) >> (i * BIT_PER_BYTE));
+	}
+	stream.erase(header_size + Codec::FRAME_HEADER_SIZE + payload_size / 2, payload_size - payload_size / 2);
+	typename IO<Byte>::IStringStream truncated(stream);
+	typename IO<symbol_type>::OStringStream discarded;
+	Codec::decode(truncated, discarded);
+	expect(truncated.fail(), "truncated frame");
+
+	return verified;
+}
+
+// Random ranges of indexed streams, some past the end, decoded from the seek index against the whole stream
+// decoded in sequence; the compressed tail comes in stored frames. INDEPENDENT streams, whose blocks are all
+// sync points, come from the parallel encoder, which takes no dictionary
+template<typename codec_type, typename... Args>
+bool check_range(char const * codec, Size symbol_num, Args const & ... args) {
+	using Codec = codec_type;
+	using symbol_type = typename Codec::Symbol;
+	using Corpus = Corpora<symbol_type>;
+
+	bool verified = true;
+	auto expect = [codec, &verified](bool condition, char const * what) {
+		if (!condition) {
+			std::cerr << "benchmark: " << codec << ": " << what << '\n';
+			verified = false;
+		}
+	};
+
+	Size size = std::max(symbol_num, RANGE_SIZE);
+	auto symbols = Corpus::text(size);
+	auto tail = Corpus::compressed(size / 4);
+	symbols.insert(symbols.end(), tail.begin(), tail.end());
+	size = symbols.size();
+
+	char const * file_name = "benchmark.range";
+	std::mt19937_64 engine(SEED + 16);
+	for (bool independent : { false, true }) {
+		if (independent && sizeof...(Args) > 0) {
+			continue;
+		}
+		StreamHeader::Flags const flags = StreamHeader::INDEXED | StreamHeader::STORED;
+		if (independent) {
+			FileBuffer<Byte> buffer(file_name);
+			typename IO<Byte>::OStream ostream(&buffer);
+			typename IO<symbol_type>::IStringStream istream(std::basic_string<symbol_type>(symbols.begin(), symbols.end()));
+			Codec::encode(istream, ostream, Size(2), size / 64 + 1, flags);
+		} else {
+			FileBuffer<Byte> buffer(file_name);
+			typename IO<Byte>::OStream ostream(&buffer);
+			typename Codec::Encoder encoder(ostream, args..., Codec::FRAME_SIZE, flags);
+			encoder.look_ahead(symbols.data(), symbols.data() + size);
+			encoder.put(symbols.data(), symbols.data() + size);
+		}
+		MappedFile input(file_name);
+		SeekIndex index;
+		expect(input.is_open() && index.get(input.data(), input.data() + input.size()), "seek index");
+
+		MemoryBuffer<Byte> buffer(input.data(), input.data() + input.size());
+		typename IO<Byte>::IStream istream(&buffer);
+		typename Codec::Decoder decoder(istream, args...);
+		std::vector<symbol_type> whole(size + 1);
+		whole.resize(decoder.get(whole.data(), whole.size()));
+		expect(!istream.fail() && whole == symbols, "indexed stream round trip");
+
+		std::vector<symbol_type> output;
+		for (Size i = 0; i < RANGE_NUM; ++i) {
+			UInt64 position = i == 0 ? size : i == 1 ? size * 2 : engine() % (size + size / 8);
+			Size count = i == 2 ? size : engine() % (size / 8);
+			Size expected = position < size ? std::min<Size>(count, size - position) : 0;
+			output.assign(count, symbol_type());
+			Size done = Codec::decode_range(input, index, position, output.data(), count, args...);
+			expect(done == expected && std::equal(output.begin(), output.begin() + expected, whole.begin() + (position < size ? position : 0)), "range decode");
+		}
+
+		// A count far past the end goes no further than the stream
+		UInt64 position = engine() % size;
+		typename IO<symbol_type>::OStringStream ostream;
+		Size done = Codec::decode_range(input, index, position, ostream, ~static_cast<Size>(0) / 2, args...);
+		expect(done == size - position && ostream.str() == std::basic_string<symbol_type>(whole.begin() + position, whole.end()), "range decode to the end");
+	}
+	std::remove(file_name);
+
+	return verified;
+}
+
+// A dictionary saved and loaded again, and streams coded from it, which no other dictionary decodes
+template<typename codec_type>
+bool check_dictionary(char const * codec, AdaptiveHuffmanDictionary<typename codec_type::Symbol> const & dictionary, std::vector<typename codec_type::Symbol> const & symbols) {
+	using Codec = codec_type;
+	using symbol_type = typename Codec::Symbol;
+	using Dictionary = AdaptiveHuffmanDictionary<symbol_type>;
+	using Symbols = std::basic_string<symbol_type>;
+
+	bool verified = true;
+	auto expect = [codec, &verified](bool condition, char const * what) {
+		if (!condition) {
+			std::cerr << "benchmark: " << codec << ": " << what << '\n';
+			verified = false;
+		}
+	};
+
+	char const * file_name = "benchmark.dictionary";
+	Dictionary loaded;
+	expect(dictionary.save(file_name) && loaded.load(file_name), "dictionary save and load");
+	std::remove(file_name);
+	expect(loaded.id() == dictionary.id() && loaded.weights() == dictionary.weights(), "dictionary loaded as saved");
+
+	// Weights scaled to no total at all stay as they are
+	Dictionary unscaled = dictionary;
+	unscaled.scale(0);
+	expect(unscaled.id() == dictionary.id(), "dictionary scaled to zero");
+
+	Symbols input(symbols.begin(), symbols.end());
+	typename IO<Byte>::OStringStream ostream;
+	{
+		typename Codec::Encoder encoder(ostream, dictionary);
+		encoder.put(input.data(), input.data() + input.size());
+	}
+	typename IO<Byte>::IStringStream coded(ostream.str());
+	typename Codec::Decoder decoder(coded, loaded);
+	Symbols output(input.size() + 1, symbol_type());
+	output.resize(decoder.get(&output[0], output.size()));
+	expect(!coded.fail() && output == input, "stream round trip from a loaded dictionary");
+
+	Dictionary other = dictionary;
+	other.train(symbols.data(), symbols.data() + 1);
+	typename IO<Byte>::IStringStream mismatched(ostream.str());
+	typename Codec::Decoder wrong(mismatched, other);
+	expect(wrong.get(&output[0], output.size()) == 0 && mismatched.fail(), "stream decoded from another dictionary");
+
+	return verified;
+}
+
+// A tree snapshot halfway through, put and got back, and a clone taken there, go on to code the rest
+// as the tree itself does; a code is the sides from leaf to root, NYT's followed by the symbol
+template<typename tree_type>
+bool check_tree(char const * tree, std::vector<typename tree_type::Symbol> const & symbols) {
+	using Tree = tree_type;
+
+	auto code = [&symbols](Tree & coder, Size first, Size last) {
+		std::vector<UInt64> codes;
+		for (Size i = first; i < last; ++i) {
+			auto cursor = coder[symbols[i]];
+			bool seen = !cursor.is_null();
+			for (cursor = seen ? cursor : coder.nyt(); !cursor.is_root(); cursor.up()) {
+				codes.push_back(static_cast<UInt64>(cursor.side()));
+			}
+			if (!seen) {
+				codes.push_back(Tree::to_internal(symbols[i]));
+			}
+			coder << symbols[i];
+		}
+		return codes;
+	};
+
+	Size half = symbols.size() / 2;
+	std::unique_ptr<Tree> original(new Tree());
+	code(*original, 0, half);
+	typename IO<Byte>::OStringStream ostream;
+	original->put(ostream);
+	typename IO<Byte>::IStringStream istream(ostream.str());
+	std::unique_ptr<Tree> restored(new Tree());
+	bool got = restored->get(istream);
+	std::unique_ptr<Tree> cloned = original->clone();
+
+	auto expected = code(*original, half, symbols.size());
+	bool verified = got && code(*restored, half, symbols.size()) == expected && code(*cloned, half, symbols.size()) == expected;
+	if (!verified) {
+		std::cerr << "benchmark: " << tree << ": snapshot codes apart from the tree" << '\n';
+	}
+	return verified;
+}
+
+template<typename codec_type>
+bool run(char const * codec, Size symbol_num, Size repetitions) {
+	using Corpus = Corpora<typename codec_type::Symbol>;
+
+	bool verified = true;
+	verified &= run_stream<codec_type>(codec, "uniform", Corpus::uniform(symbol_num), repetitions);
+	verified &= run_stream<codec_type>(codec, "skewed", Corpus::skewed(symbol_num), repetitions);
+	verified &= run_stream<codec_type>(codec, "drifting", Corpus::drifting(symbol_num), repetitions);
+	verified &= run_stream<codec_type>(codec, "text", Corpus::text(symbol_num), repetitions);
+	verified &= run_stream<codec_type>(codec, "compressed", Corpus::compressed(symbol_num), repetitions);
+	verified &= run_stream<codec_type>(codec, "compressed/stored", Corpus::compressed(symbol_num), repetitions, StreamHeader::STORED);
+	verified &= run_stream<codec_type>(codec, "sparse", Corpus::sparse(symbol_num), repetitions);
+	verified &= run_tiny<codec_type>(codec, Corpus::text(symbol_num / 16), repetitions);
+	verified &= check<codec_type>(codec, Corpus::text(symbol_num / 16));
+	verified &= check_range<codec_type>(codec, symbol_num);
+	return verified;
+}
+
+// Tiny messages again, from a dictionary trained on the text that follows them
+template<typename codec_type>
+bool run_dictionary(char const * codec, Size symbol_num, Size repetitions) {
+	using Symbol = typename codec_type::Symbol;
+	using Corpus = Corpora<Symbol>;
+
+	auto sample = Corpus::text(symbol_num);
+	AdaptiveHuffmanDictionary<Symbol> dictionary;
+	dictionary.train(sample.data() + symbol_num / 16, sample.data() + sample.size());
+	dictionary.scale();
+	bool verified = run_tiny<codec_type>(codec, Corpus::text(symbol_num / 16), repetitions, dictionary);
+	verified &= check_dictionary<codec_type>(codec, dictionary, Corpus::text(symbol_num / 16));
+	verified &= check_range<codec_type>(codec, symbol_num, dictionary);
+	return verified;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 3) {
+		usage();
+		return -1;
+	}
+	Size symbol_num = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024 * 1024;
+	Size repetitions = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 3;
+	if (symbol_num == 0 || repetitions == 0) {
+		usage();
+		return -1;
+	}
+
+	bool verified = true;
+	verified &= run<AdaptiveHuffmanCodec<char>>("char", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<char, 14>>("char/rescale14", symbol_num, repetitions);
+	verified &= run<LengthLimitedAdaptiveHuffmanCodec<char, 16>>("char/length16", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<char, 0, VitterUpdate>>("char/vitter", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<char, 0, FGKUpdate, true>>("char/run", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<char, 0, FGKUpdate, false, SymbolContext<1>>>("char/order1", symbol_num, repetitions);
+	verified &= run_dictionary<AdaptiveHuffmanCodec<char>>("char/dictionary", symbol_num, repetitions);
+	verified &= run<StaticHuffmanCodec<char>>("char/static", symbol_num, repetitions);
+	verified &= run<StaticHuffmanCodec<char, 4>>("char/static4", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<UInt16>>("uint16", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<UInt16, 18>>("uint16/rescale18", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<UInt16, 0, VitterUpdate>>("uint16/vitter", symbol_num, repetitions);
+	verified &= run<StaticHuffmanCodec<UInt16>>("uint16/static", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<UInt32>>("uint32", symbol_num, repetitions);
+	verified &= run<AdaptiveHuffmanCodec<wchar_t>>("wchar_t", symbol_num, repetitions);
+
+	verified &= check_tree<AdaptiveHuffmanTree<char>>("char/fgk", Corpora<char>::text(symbol_num / 16));
+	verified &= check_tree<AdaptiveHuffmanTree<char, 10>>("char/fgk/rescale10", Corpora<char>::text(symbol_num / 16));
+	verified &= check_tree<VitterHuffmanTree<char>>("char/vitter", Corpora<char>::text(symbol_num / 16));
+	verified &= check_tree<VitterHuffmanTree<char, 10>>("char/vitter/rescale10", Corpora<char>::text(symbol_num / 16));
+	verified &= check_tree<AdaptiveHuffmanTree<UInt16>>("uint16/fgk", Corpora<UInt16>::skewed(symbol_num / 16));
+	verified &= check_tree<VitterHuffmanTree<UInt16>>("uint16/vitter", Corpora<UInt16>::skewed(symbol_num / 16));
+
+	return verified ? 0 : -1;
+}
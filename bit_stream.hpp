@@ -0,0 +1,247 @@
+#ifndef __BIT_STREAM_HPP__
+#define __BIT_STREAM_HPP__
+
+#include "type.hpp"
+#include "bit_math.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Bits are packed least significant first, words are stored little endian
+
+inline UInt64 load_word(Byte const * bytes) {
+	UInt64 word = 0;
+	for (Size i = 0; i < ByteSize<UInt64>::value; ++i) {
+		word |= static_cast<UInt64>(bytes[i]) << (i * BIT_PER_BYTE);
+	}
+	return word;
+}
+
+inline void store_word(Byte * bytes, UInt64 word) {
+	for (Size i = 0; i < ByteSize<UInt64>::value; ++i) {
+		bytes[i] = static_cast<Byte>(word >> (i * BIT_PER_BYTE));
+	}
+}
+
+inline UInt64 low_mask(Size n) {
+	return n < BitSize<UInt64>::value ? (static_cast<UInt64>(1) << n) - 1 : ~static_cast<UInt64>(0);
+}
+
+// Packs bits into a growing in-memory block, the owner decides where the bytes go;
+// the block may also be memory of the caller, left for an owned one only if it runs out
+class BitWriter {
+private:
+	using Self = BitWriter;
+
+public:
+	static Size const BLOCK_SIZE = 64 * 1024;
+
+private:
+	std::vector<Byte> storage;
+	Byte * block;
+	Size block_size;
+	Size block_used;
+	UInt64 accumulator;
+	Size accumulator_bit;
+
+public:
+	// The block starts at block_size rounded up to whole words and grows as needed
+	BitWriter(Size block_size = BLOCK_SIZE) :
+		storage((block_size / ByteSize<UInt64>::value + 1) * ByteSize<UInt64>::value),
+		block(storage.data()),
+		block_size(storage.size()),
+		block_used(0),
+		accumulator(0),
+		accumulator_bit(0) {
+		// do nothing
+	}
+
+	// Put the low n bits of bits, n is at most 64
+	void put_bits(UInt64 bits, Size n) {
+		assert(n <= BitSize<UInt64>::value && (bits & ~low_mask(n)) == 0);
+		if (n == 0) {
+			return;
+		}
+		accumulator |= bits << accumulator_bit;
+		accumulator_bit += n;
+		if (accumulator_bit >= BitSize<UInt64>::value) {
+			if (block_used + ByteSize<UInt64>::value > block_size) {
+				grow();
+			}
+			store_word(block + block_used, accumulator);
+			block_used += ByteSize<UInt64>::value;
+			accumulator_bit -= BitSize<UInt64>::value;
+			accumulator = accumulator_bit > 0 ? bits >> (n - accumulator_bit) : 0;
+		}
+	}
+
+	void put_bit(Bit bit) {
+		put_bits(static_cast<UInt64>(bit), 1);
+	}
+
+	// Bytes the block would take if flushed now
+	Size byte_count() const {
+		return block_used + (accumulator_bit + BIT_PER_BYTE - 1) / BIT_PER_BYTE;
+	}
+
+	// Pad the last byte with zero bits, the whole block is then data()[0, size())
+	void flush() {
+		Size tail = (accumulator_bit + BIT_PER_BYTE - 1) / BIT_PER_BYTE;
+		if (block_used + tail > block_size) {
+			grow();
+		}
+		for (Size i = 0; i < tail; ++i) {
+			block[block_used++] = static_cast<Byte>(accumulator >> (i * BIT_PER_BYTE));
+		}
+		accumulator = 0;
+		accumulator_bit = 0;
+	}
+
+	Byte const * data() const {
+		return block;
+	}
+
+	Size size() const {
+		return block_used;
+	}
+
+	// Start a new block in the owned memory
+	void clear() {
+		block = storage.data();
+		block_size = storage.size();
+		block_used = 0;
+		accumulator = 0;
+		accumulator_bit = 0;
+	}
+
+	// Start a new block in capacity bytes at output
+	void clear(Byte * output, Size capacity) {
+		clear();
+		block = output;
+		block_size = capacity;
+	}
+
+private:
+	void grow() {
+		if (block != storage.data() && block_used + ByteSize<UInt64>::value <= storage.size()) {
+			// Out of the memory of the caller, go on in owned memory
+			std::copy(block, block + block_used, storage.begin());
+		} else {
+			std::vector<Byte> larger(storage.size() * 2 + block_used);
+			std::copy(block, block + block_used, larger.begin());
+			storage.swap(larger);
+		}
+		block = storage.data();
+		block_size = storage.size();
+	}
+
+private:
+	BitWriter(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class BitWriter
+
+// Unpacks bits from a range of memory
+class BitReader {
+private:
+	using Self = BitReader;
+
+public:
+	// Widest read that a single refill can always serve
+	static Size const MAX_PEEK_BIT = BitSize<UInt64>::value - BIT_PER_BYTE;
+
+private:
+	Byte const * cursor;
+	Byte const * end;
+	UInt64 accumulator;
+	Size accumulator_bit;
+	bool overrun; /* bits were consumed past the end of input */
+
+public:
+	BitReader() : cursor(nullptr), end(nullptr), accumulator(0), accumulator_bit(0), overrun(false) {
+		// do nothing
+	}
+
+	BitReader(Byte const * begin, Byte const * end) : BitReader() {
+		reset(begin, end);
+	}
+
+	void reset(Byte const * begin, Byte const * end) {
+		this->cursor = begin;
+		this->end = end;
+		accumulator = 0;
+		accumulator_bit = 0;
+		overrun = false;
+	}
+
+	// Look at the next n bits without consuming them, past the end of input reads zeros
+	UInt64 peek_bits(Size n) {
+		assert(n <= MAX_PEEK_BIT);
+		if (accumulator_bit < n) {
+			refill();
+		}
+		return accumulator & low_mask(n);
+	}
+
+	// Consume n bits that a peek_bits has just looked at; those past the end of input are the
+	// zeros it read there, consuming them marks the reader overrun, as only malformed input does
+	void skip_bits(Size n) {
+		if (n > accumulator_bit) {
+			overrun = true;
+			n = accumulator_bit;
+		}
+		accumulator >>= n;
+		accumulator_bit -= n;
+	}
+
+	UInt64 get_bits(Size n) {
+		UInt64 bits = peek_bits(n);
+		skip_bits(n);
+		return bits;
+	}
+
+	Bit get_bit() {
+		return static_cast<Bit>(get_bits(1));
+	}
+
+	// Drop what is left of a partly read byte and return where the unread bytes start
+	Byte const * align() {
+		Byte const * position = cursor - accumulator_bit / BIT_PER_BYTE;
+		bool was_overrun = overrun;
+		reset(position, end);
+		overrun = was_overrun;
+		return position;
+	}
+
+	Byte const * limit() const {
+		return end;
+	}
+
+	// Whether bits were consumed past the end of input since the last reset
+	bool is_overrun() const {
+		return overrun;
+	}
+
+private:
+	// Top the accumulator up to at least MAX_PEEK_BIT bits, unless input runs out;
+	// the fast path also leaves bits of the next byte above accumulator_bit,
+	// which are the same bits a later refill ors in again
+	void refill() {
+		if (end - cursor >= static_cast<std::ptrdiff_t>(ByteSize<UInt64>::value)) {
+			accumulator |= load_word(cursor) << accumulator_bit;
+			cursor += (BitSize<UInt64>::value - 1 - accumulator_bit) / BIT_PER_BYTE;
+			accumulator_bit |= MAX_PEEK_BIT;
+			return;
+		}
+		for (; accumulator_bit <= MAX_PEEK_BIT && cursor != end; accumulator_bit += BIT_PER_BYTE) {
+			accumulator |= static_cast<UInt64>(*cursor++) << accumulator_bit;
+		}
+	}
+
+private:
+	BitReader(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class BitReader
+
+#endif // __BIT_STREAM_HPP__
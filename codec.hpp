@@ -3,9 +3,392 @@
 
 #include "type.hpp"
 #include "bit_math.hpp"
+#include "bit_stream.hpp"
+#include "file_io.hpp"
+#include "symbol_index.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Write value as byte_size little endian bytes
+template<typename value_type>
+inline void put_integer(typename IO<Byte>::OStream & ostream, value_type value, Size byte_size) {
+	Byte bytes[ByteSize<UInt64>::value];
+	for (Size i = 0; i < byte_size; ++i) {
+		bytes[i] = static_cast<Byte>(static_cast<UInt64>(value) >> (i * BIT_PER_BYTE));
+	}
+	ostream.write(bytes, byte_size);
+}
+
+// Read byte_size little endian bytes into value, false if input ran out
+template<typename value_type>
+inline bool get_integer(typename IO<Byte>::IStream & istream, value_type & value, Size byte_size) {
+	Byte bytes[ByteSize<UInt64>::value];
+	if (!istream.read(bytes, byte_size)) {
+		return false;
+	}
+	UInt64 integer = 0;
+	for (Size i = 0; i < byte_size; ++i) {
+		integer |= static_cast<UInt64>(bytes[i]) << (i * BIT_PER_BYTE);
+	}
+	value = static_cast<value_type>(integer);
+	return true;
+}
+
+// Read size bytes into bytes, false if input ran out; bytes grow a block at a time as they arrive,
+// so that a size the input does not hold is never allocated whole
+inline bool get_bytes(typename IO<Byte>::IStream & istream, std::vector<Byte> & bytes, Size size) {
+	Size const BLOCK_SIZE = 1024 * 1024;
+	bytes.clear();
+	for (Size done = 0; done < size; ) {
+		Size block = size - done < BLOCK_SIZE ? size - done : BLOCK_SIZE;
+		bytes.resize(done + block);
+		if (!istream.read(bytes.data() + done, block)) {
+			return false;
+		}
+		done += block;
+	}
+	return true;
+}
+
+// Write value 7 bits a byte, low bits first, returning the end of what was written
+inline Byte * put_varint(Byte * output, UInt64 value) {
+	for (; value >= 0x80; value >>= 7) {
+		*output++ = static_cast<Byte>(value | 0x80);
+	}
+	*output++ = static_cast<Byte>(value);
+	return output;
+}
+
+// Read a value written by put_varint, returning the end of what was read, or null if input ran out
+inline Byte const * get_varint(Byte const * input, Byte const * end, UInt64 & value) {
+	value = 0;
+	for (Size shift = 0; input != end && shift < BitSize<UInt64>::value; shift += 7) {
+		Byte byte = *input++;
+		value |= static_cast<UInt64>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return input;
+		}
+	}
+	return nullptr;
+}
+
+inline void put_varint(typename IO<Byte>::OStream & ostream, UInt64 value) {
+	Byte bytes[10];
+	ostream.write(bytes, put_varint(bytes, value) - bytes);
+}
+
+// Read a value written by put_varint from a stream, false if it ran out
+inline bool get_varint(typename IO<Byte>::IStream & istream, UInt64 & value) {
+	Byte bytes[10];
+	Size size = 0;
+	do {
+		if (size == sizeof(bytes) || !istream.read(bytes + size, 1)) {
+			return false;
+		}
+	} while ((bytes[size++] & 0x80) != 0);
+	return get_varint(bytes, bytes + size, value) != nullptr;
+}
+
+// Bits an order-0 code of the symbols in [first, last) takes at least: each symbol the bits of its share
+// of them, plus every distinct symbol spelt out once, as a static code sends them ahead and an adaptive one after NYT
+template<typename symbol_type>
+inline double order0_bits(symbol_type const * first, symbol_type const * last) {
+	using Key = typename Unsigned<symbol_type>::Type;
+	SymbolIndex<UInt32, BitSize<symbol_type>::value> index;
+	std::vector<UInt32> counts;
+	for (; first != last; ++first) {
+		Key key = static_cast<Key>(*first);
+		UInt32 slot = index[key];
+		if (slot == 0) {
+			counts.push_back(0);
+			slot = static_cast<UInt32>(counts.size());
+			index.set(key, slot);
+		}
+		++counts[slot - 1];
+	}
+	double total = 0, bits = 0;
+	for (UInt32 count : counts) {
+		total += count;
+		bits -= count * std::log2(static_cast<double>(count));
+	}
+	if (total > 0) {
+		bits += total * std::log2(total);
+	}
+	return bits + static_cast<double>(counts.size()) * BitSize<symbol_type>::value;
+}
+
+/*
+ * Stream layout, integers are little endian:
+ *   header: magic "AHCF" (4), version (1), symbol bit (1), model (1), flags (1),
+ *           then rescale bit (1) if the RESCALE flag is set,
+ *           then context order (1), context bit (1) and tree bit (1) if the CONTEXT flag is set,
+ *           then dictionary id (4) if the DICTIONARY flag is set
+ *   frames: payload size (4), symbol count (4), payload
+ *   end:    a frame of zero size and zero symbols
+ * The model byte tells which model coded the stream: 0 and 1 are the FGK and Vitter adaptive
+ * trees, 2 a static code; each coder checks it is its own. A static code sent once for the
+ * whole stream sits between the header and the first frame, see StaticHuffmanEncoder.
+ * With the RUN flag, the adaptive trees hold a run escape next to NYT, see AdaptiveHuffmanRuns;
+ * with the CONTEXT flag, the last symbols pick one of several trees, see SymbolContext; with the
+ * DICTIONARY flag, they start from the weights of the dictionary of that id, see AdaptiveHuffmanDictionary.
+ * Each payload is padded to whole bytes. The model goes on from one frame to the next,
+ * unless the INDEPENDENT flag says every frame starts from a fresh model. Either way a
+ * decoder reads the input once, front to back, and needs no seeking.
+ * With the STORED flag, a symbol count with its top bit set, STORED_COUNT, marks a stored frame:
+ * its payload is the symbols themselves, SYMBOL_BIT bits each as put_plain writes them, and the
+ * model neither codes nor learns them, so it goes on after the frame as it was before it.
+ * With the INDEXED flag, a seek index follows the end frame, see SeekIndex; decoders reading
+ * front to back stop at the end frame and never look at it.
+ */
+struct StreamHeader {
+	static UInt32 const MAGIC = 0x46434841; // "AHCF"
+	static Byte const VERSION = 1;
+	static Size const SIZE = 8;
+
+	// Bits of the flags field, combined with |
+	enum Flags : Byte {
+		INDEPENDENT = 0x01, // frames do not share the model
+		RESCALE = 0x02, // weights are halved whenever the root weight reaches 1 << rescale_bit
+		RUN = 0x04, // repeats of the last symbol may come as a run escape and a length
+		CONTEXT = 0x08, // the last context_order symbols pick the tree of the next
+		DICTIONARY = 0x10, // models start from a dictionary both sides hold
+		INDEXED = 0x20, // a seek index follows the end frame
+		STORED = 0x40 // frames that coding would not shrink may be stored raw
+	};
+
+	friend Flags operator|(Flags a, Flags b) {
+		return static_cast<Flags>(static_cast<Byte>(a) | static_cast<Byte>(b));
+	}
+
+	static UInt32 const STORED_COUNT = 0x80000000; // in the symbol count of a frame, the frame is stored
+
+	Byte version;
+	Byte symbol_bit;
+	Byte model;
+	Byte flags;
+	Byte rescale_bit; /* zero when the RESCALE flag is clear */
+	Byte context_order; /* the rest are zero when the CONTEXT flag is clear */
+	Byte context_bit;
+	Byte tree_bit;
+	UInt32 dictionary_id; /* zero when the DICTIONARY flag is clear */
+
+	// Header of a stream coded by model with the given rescale bit, zero for none
+	static StreamHeader make(Size symbol_bit, Byte flags, Size rescale_bit, Byte model = 0) {
+		if (rescale_bit != 0) {
+			flags |= RESCALE;
+		}
+		return StreamHeader{ VERSION, static_cast<Byte>(symbol_bit), model, flags, static_cast<Byte>(rescale_bit), 0, 0, 0, 0 };
+	}
+
+	// Header of a stream coded by coder_type, which adds its own flags to the given ones,
+	// from the dictionary of the given id unless it is zero
+	template<typename coder_type>
+	static StreamHeader of(Byte flags, UInt32 dictionary_id = 0) {
+		StreamHeader header = make(coder_type::SYMBOL_BIT, flags | coder_type::FLAGS, coder_type::RESCALE_BIT, coder_type::MODEL);
+		if (coder_type::CONTEXT_ORDER != 0) {
+			header.flags |= CONTEXT;
+			header.context_order = static_cast<Byte>(coder_type::CONTEXT_ORDER);
+			header.context_bit = static_cast<Byte>(coder_type::CONTEXT_BIT);
+			header.tree_bit = static_cast<Byte>(coder_type::TREE_BIT);
+		}
+		if (dictionary_id != 0) {
+			header.flags |= DICTIONARY;
+			header.dictionary_id = dictionary_id;
+		}
+		return header;
+	}
+
+	// Whether symbols are coded alike in both streams, whatever their frames
+	bool is_coded_as(StreamHeader const & other) const {
+		Byte const CODING = RESCALE | RUN | CONTEXT | DICTIONARY;
+		return symbol_bit == other.symbol_bit && model == other.model && (flags & CODING) == (other.flags & CODING)
+			&& rescale_bit == other.rescale_bit && context_order == other.context_order && context_bit == other.context_bit && tree_bit == other.tree_bit
+			&& dictionary_id == other.dictionary_id;
+	}
+
+	void put(typename IO<Byte>::OStream & ostream) const {
+		put_integer(ostream, MAGIC, ByteSize<UInt32>::value);
+		Byte const bytes[] = { version, symbol_bit, model, flags };
+		ostream.write(bytes, sizeof(bytes));
+		if ((flags & RESCALE) != 0) {
+			ostream.write(&rescale_bit, 1);
+		}
+		if ((flags & CONTEXT) != 0) {
+			Byte const context[] = { context_order, context_bit, tree_bit };
+			ostream.write(context, sizeof(context));
+		}
+		if ((flags & DICTIONARY) != 0) {
+			put_integer(ostream, dictionary_id, ByteSize<UInt32>::value);
+		}
+	}
+
+	bool get(typename IO<Byte>::IStream & istream) {
+		UInt32 magic;
+		Byte bytes[4];
+		if (!get_integer(istream, magic, ByteSize<UInt32>::value) || !istream.read(bytes, sizeof(bytes))) {
+			return false;
+		}
+		version = bytes[0];
+		symbol_bit = bytes[1];
+		model = bytes[2];
+		flags = bytes[3];
+		rescale_bit = context_order = context_bit = tree_bit = 0;
+		dictionary_id = 0;
+		if ((flags & RESCALE) != 0 && !istream.read(&rescale_bit, 1)) {
+			return false;
+		}
+		if ((flags & CONTEXT) != 0) {
+			Byte context[3];
+			if (!istream.read(context, sizeof(context))) {
+				return false;
+			}
+			context_order = context[0];
+			context_bit = context[1];
+			tree_bit = context[2];
+		}
+		if ((flags & DICTIONARY) != 0 && !get_integer(istream, dictionary_id, ByteSize<UInt32>::value)) {
+			return false;
+		}
+		return magic == MAGIC && version == VERSION;
+	}
+};
+
+/*
+ * Sync points of a stream, where decoding can start instead of at the first frame: each is the
+ * start of a frame, with the model there, so that a decoder that takes it on goes on from that
+ * frame as if it had decoded all before. Models of coders that do not change them from frame to
+ * frame are empty, and so are fresh ones, at the first frame and throughout independent frames.
+ * A sync point is due once the frames since the last one take interval bytes, and MODEL_RATIO
+ * times the size of the last model made, kept or not; a point whose model is larger than that is
+ * dropped, so that large models, such as those of many contexts, take a bounded share of the stream.
+ * Layout, after the end frame: the number of sync points (varint), then for each the bytes of
+ * the frames before it, the symbols before it and the size of its model (varint each), then the
+ * model as the coder put it; last, the size of all that (8) and the magic "AHCI" (4).
+ */
+class SeekIndex {
+private:
+	using Self = SeekIndex;
+
+public:
+	static UInt32 const MAGIC = 0x49434841; // "AHCI"
+	static Size const TRAILER_SIZE = ByteSize<UInt64>::value + ByteSize<UInt32>::value;
+	static Size const INTERVAL = 256 * 1024; // frame bytes between sync points, at least
+	static Size const MODEL_RATIO = 16;
+
+	struct SyncPoint {
+		UInt64 offset; /* bytes of the frames before, from the first frame on */
+		UInt64 symbol; /* symbols before */
+		std::basic_string<Byte> model; /* as put_model wrote it, empty for one the decoder has anyway */
+	};
+
+private:
+	std::vector<SyncPoint> points;
+	Size interval;
+	Size model_size; /* of the last model made */
+
+public:
+	explicit SeekIndex(Size interval = INTERVAL) : interval(interval), model_size(0) {
+		// do nothing
+	}
+
+	Size size() const {
+		return points.size();
+	}
+
+	// Whether a sync point is due at a frame offset bytes in
+	bool is_due(UInt64 offset) const {
+		return points.empty() || offset - points.back().offset >= gap(model_size);
+	}
+
+	// Add a sync point, unless its model is too large for the bytes since the last one
+	void add(UInt64 offset, UInt64 symbol, std::basic_string<Byte> model) {
+		assert(points.empty() || (offset > points.back().offset && symbol > points.back().symbol));
+		model_size = model.size();
+		if (points.empty() || offset - points.back().offset >= gap(model_size)) {
+			points.push_back(SyncPoint{offset, symbol, std::move(model)});
+		}
+	}
+
+	// The last sync point at or before the symbol at position, null if there is none
+	SyncPoint const * find(UInt64 position) const {
+		auto after = std::upper_bound(points.begin(), points.end(), position, [](UInt64 position, SyncPoint const & point) {
+			return position < point.symbol;
+		});
+		return after != points.begin() ? &*(after - 1) : nullptr;
+	}
+
+	void put(typename IO<Byte>::OStream & ostream) const {
+		Byte bytes[3 * 10];
+		UInt64 size = put_varint(bytes, points.size()) - bytes;
+		ostream.write(bytes, size);
+		for (auto const & point : points) {
+			Byte * end = put_varint(put_varint(put_varint(bytes, point.offset), point.symbol), point.model.size());
+			ostream.write(bytes, end - bytes);
+			ostream.write(point.model.data(), point.model.size());
+			size += (end - bytes) + point.model.size();
+		}
+		put_integer(ostream, size, ByteSize<UInt64>::value);
+		put_integer(ostream, MAGIC, ByteSize<UInt32>::value);
+	}
+
+	// Read the index at the end of the stream in [begin, end), false if there is none or it is malformed
+	bool get(Byte const * begin, Byte const * end) {
+		points.clear();
+		UInt64 size = 0, magic = 0, count;
+		Size length = end - begin;
+		if (length < TRAILER_SIZE) {
+			return false;
+		}
+		for (Size i = 0; i < ByteSize<UInt64>::value; ++i) {
+			size |= static_cast<UInt64>(end[i - TRAILER_SIZE]) << (i * BIT_PER_BYTE);
+		}
+		for (Size i = 0; i < ByteSize<UInt32>::value; ++i) {
+			magic |= static_cast<UInt64>(end[i - ByteSize<UInt32>::value]) << (i * BIT_PER_BYTE);
+		}
+		if (magic != MAGIC || size > length - TRAILER_SIZE) {
+			return false;
+		}
+		end -= TRAILER_SIZE;
+		Byte const * input = get_varint(end - size, end, count);
+		for (UInt64 i = 0; input != nullptr && i < count; ++i) {
+			UInt64 offset, symbol, model_size;
+			if ((input = get_varint(input, end, offset)) == nullptr || (input = get_varint(input, end, symbol)) == nullptr
+				|| (input = get_varint(input, end, model_size)) == nullptr || model_size > static_cast<UInt64>(end - input)
+				|| (!points.empty() && (offset <= points.back().offset || symbol <= points.back().symbol))) {
+				input = nullptr;
+				break;
+			}
+			points.push_back(SyncPoint{offset, symbol, std::basic_string<Byte>(input, input + model_size)});
+			input += model_size;
+		}
+		if (input != end) {
+			points.clear();
+			return false;
+		}
+		return true;
+	}
+
+private:
+	UInt64 gap(Size model_size) const {
+		return interval > MODEL_RATIO * model_size ? interval : MODEL_RATIO * model_size;
+	}
+
+private:
+	SeekIndex(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+};
 
 template<typename symbol_type>
 class CodecBase {
@@ -17,9 +400,41 @@ public:
 
 	static Size const SYMBOL_BIT = BitSize<Symbol>::value;
 	static Size const SYMBOL_NUM = static_cast<Size>(1) << SYMBOL_BIT;
+
+	static Size const FRAME_SIZE = 64 * 1024; // payload bytes after which a frame is closed
+	static Size const FRAME_HEADER_SIZE = 2 * ByteSize<UInt32>::value;
+
+	static Size const VARINT_SIZE = 10; // most bytes a put_varint takes
+
+	static Size const STORED_MIN_COUNT = 4096; // fewer symbols at hand are always coded, too few to tell
+	static Size const STORED_MARGIN = 32; // a frame is stored unless coding saves more than 1 / STORED_MARGIN of it
+	static Size const STORED_PIECE_SIZE = 16 * 1024; // symbols estimated at a time, see Encoder::is_incompressible
+
+	static Size const RESCALE_BIT = 0; // weights are never rescaled
+	static Byte const MODEL = 0;
+	static Byte const FLAGS = 0; // flags of the stream header set by the coder itself, such as RUN
+	static Size const CONTEXT_ORDER = 0; // a single tree, see SymbolContext
+	static Size const CONTEXT_BIT = 0;
+	static Size const TREE_BIT = 0;
+	static Size const ERROR_SIZE = ~static_cast<Size>(0);
+
+	// Bytes of a stored frame of count symbols
+	static Size stored_size(Size count) {
+		return (count * SYMBOL_BIT + BIT_PER_BYTE - 1) / BIT_PER_BYTE;
+	}
 };
 
-template<typename symbol_type>
+/*
+ * Encoder and Decoder are bases in the curiously recurring template pattern: a coder passes itself
+ * as derived_type, and the calls it may redefine (put_run, get_run, reset, look_ahead, is_worth_storing,
+ * is_good, is_malformed, payload_bound, start_frame) go straight to it, so that a Codec loop inlines whole with no indirect call per symbol.
+ * Left void, derived_type makes them plain coders of SYMBOL_BIT bits a symbol. Callers that pick a
+ * coder at run time go through PolymorphicEncoder and PolymorphicDecoder.
+ * Symbols go in and out in runs: put_run and get_run code many symbols in one loop, while put and get
+ * keep the counts and frames once per run; a single symbol is a run of one.
+ */
+
+template<typename symbol_type, typename derived_type = void>
 class Encoder : public CodecBase<symbol_type> {
 private:
 	using Self = Encoder;
@@ -28,70 +443,265 @@ public:
 	using Symbol = symbol_type;
 
 	using Base = CodecBase<Symbol>;
+	using Derived = typename Conditional<IsSame<derived_type, void>::value, Self, derived_type>::Type;
 
 	using IStream = typename IO<Symbol>::IStream;
 	using OStream = typename IO<Byte>::OStream;
 
 protected:
-	static Size const BUFFER_SIZE = 256;
-	static Size const BUFFER_BIT = BUFFER_SIZE * BitSize<Byte>::value;
-
-	OStream & ostream;
-	Byte buffer[BUFFER_SIZE];
-	Size buffer_bit;
+	OStream * ostream; /* null when detached, the owner then takes the frames */
+	BitWriter writer;
+	Size frame_size;
+	Size frame_count; /* symbols in the open frame */
 	Size symbol_count;
+	StreamHeader header;
+	UInt64 frame_bytes; /* of the frames put */
+	std::unique_ptr<SeekIndex> index; /* null unless the INDEXED flag is set */
 
 public:
-	Encoder(OStream & os) : ostream(os), symbol_count(0) {
-		clear_buffer();
+	Encoder(OStream & os, Size frame_size = Base::FRAME_SIZE, Byte flags = 0, UInt32 dictionary_id = 0) :
+		ostream(&os),
+		writer(frame_size + ByteSize<UInt64>::value),
+		frame_size(frame_size),
+		frame_count(0),
+		symbol_count(0),
+		header(StreamHeader::of<Derived>(flags, dictionary_id)),
+		frame_bytes(0),
+		index(make_index(header.flags)) {
+		header.put(*ostream);
 	}
 
-	virtual ~Encoder() {
-		flush();
-		put_count();
+	// A detached encoder codes a single open frame, see take_frame
+	explicit Encoder(UInt32 dictionary_id = 0) :
+		ostream(nullptr),
+		frame_size(0),
+		frame_count(0),
+		symbol_count(0),
+		header(StreamHeader::of<Derived>(StreamHeader::INDEPENDENT, dictionary_id)),
+		frame_bytes(0) {
+		// do nothing
 	}
 
-	virtual Self & put(Symbol symbol) {
-		put_plain(symbol);
-		++symbol_count;
-		return *this;
-	};
+	~Encoder() {
+		if (ostream != nullptr) {
+			put_frame();
+			put_end();
+		}
+	}
+
+	Derived & put(Symbol symbol) {
+		put(&symbol, &symbol + 1);
+		return derived();
+	}
+
+	// Put the symbols of [first, last) and return how many were put, which is all of them
+	Size put(Symbol const * first, Symbol const * last) {
+		Size byte_limit = ostream == nullptr ? ~static_cast<Size>(0) : frame_size > 0 ? frame_size : 1;
+		for (Symbol const * cursor = first; cursor != last; ) {
+			if (index != nullptr && frame_count == 0 && index->is_due(frame_bytes)) {
+				put_sync_point();
+			}
+			if (frame_count == 0 && ostream != nullptr && (header.flags & StreamHeader::STORED) != 0) {
+				Size count = put_stored(cursor, last);
+				if (count > 0) {
+					cursor += count;
+					symbol_count += count;
+					continue;
+				}
+			}
+			Size count = derived().put_run(cursor, last, byte_limit);
+			if (count == 0) {
+				// The open frame is big enough, close it before the next symbol
+				derived().put_frame();
+				if ((header.flags & StreamHeader::INDEPENDENT) != 0) {
+					derived().reset();
+				}
+				continue;
+			}
+			cursor += count;
+			symbol_count += count;
+			frame_count += count;
+		}
+		return last - first;
+	}
+
+	// Start over from a fresh model
+	void reset() {
+		// do nothing
+	}
+
+	// Write the model, for a decoder to go on from, see SeekIndex; models that do not change from frame to frame write nothing
+	void put_model(OStream & /* ostream */) const {
+		// do nothing
+	}
+
+	// The symbols about to be put, before the first symbol of an attached encoder or of each
+	// frame of a detached one, for models built ahead of coding; adaptive models ignore them
+	void look_ahead(Symbol const * /* first */, Symbol const * /* last */) {
+		// do nothing
+	}
 
 	Size count() {
 		return symbol_count;
 	}
 
-	Self & operator<<(Symbol symbol) {
-		return put(symbol);
+	Derived & operator<<(Symbol symbol) {
+		return derived().put(symbol);
+	}
+
+	// Most bytes a frame of count symbols can take
+	static Size bound(Size count) {
+		return Base::stored_size(count);
+	}
+
+	// Whether coding the symbols of [first, last) would hardly shrink them, by an estimate far cheaper than
+	// coding them, see order0_bits; pieces are estimated apart, as an adaptive model follows the symbols
+	// from one part to the next, and models of several contexts may still do better
+	static bool is_incompressible(Symbol const * first, Symbol const * last) {
+		double raw_bits = static_cast<double>(last - first) * Base::SYMBOL_BIT;
+		double bits = 0;
+		for (Symbol const * piece = first; piece != last; ) {
+			Symbol const * end = static_cast<Size>(last - piece) < 2 * Base::STORED_PIECE_SIZE ? last : piece + Base::STORED_PIECE_SIZE;
+			bits += order0_bits(piece, end);
+			piece = end;
+		}
+		return bits >= raw_bits - raw_bits / Base::STORED_MARGIN;
+	}
+
+	// Whether the symbols of [first, last), a whole frame about to open, had better be stored, see put_stored;
+	// coders that know what coding them takes tell better than the estimate
+	bool is_worth_storing(Symbol const * first, Symbol const * last) {
+		return is_incompressible(first, last);
+	}
+
+	// Move the symbols of [first, last) into payload as a stored frame holds them, see StreamHeader
+	void take_stored(Symbol const * first, Symbol const * last, std::vector<Byte> & payload) {
+		writer.clear();
+		Self::put_run(first, last, ~static_cast<Size>(0));
+		writer.flush();
+		payload.assign(writer.data(), writer.data() + writer.size());
+		writer.clear();
+	}
+
+	// Code the open frame straight into capacity bytes at output, see take_frame
+	void open_frame(Byte * output, Size capacity) {
+		writer.clear(output, capacity);
+		frame_count = 0;
+	}
+
+	// Finish the open frame at output and return its size, ERROR_SIZE if it exceeds capacity
+	Size take_frame(Byte * output, Size capacity) {
+		writer.flush();
+		Size size = writer.size();
+		if (writer.data() != output) {
+			if (size > capacity) {
+				size = Base::ERROR_SIZE;
+			} else {
+				std::copy(writer.data(), writer.data() + size, output);
+			}
+		}
+		writer.clear();
+		frame_count = 0;
+		return size;
+	}
+
+	// Move the open frame into payload and return its symbol count
+	Size take_frame(std::vector<Byte> & payload) {
+		writer.flush();
+		payload.assign(writer.data(), writer.data() + writer.size());
+		writer.clear();
+		Size count = frame_count;
+		frame_count = 0;
+		return count;
 	}
 
 protected:
-	void clear_buffer() {
-		std::uninitialized_fill(buffer, buffer + BUFFER_SIZE, static_cast<Byte>(0));
-		buffer_bit = 0;
+	// Code symbols from first on, stopping at last or before a symbol that finds the open frame
+	// at byte_limit bytes, and return how many were coded; put keeps the counts
+	Size put_run(Symbol const * first, Symbol const * last, Size byte_limit) {
+		Symbol const * cursor = first;
+		for (; cursor != last && writer.byte_count() < byte_limit; ++cursor) {
+			put_plain(*cursor);
+		}
+		return cursor - first;
 	}
 
-	void flush() {
-		ostream.write(buffer, (buffer_bit + BitSize<Byte>::value - 1) / BitSize<Byte>::value);
-		buffer_bit = 0;
+	Derived & derived() {
+		return static_cast<Derived &>(*this);
 	}
 
-	void put_count() {
-		ostream.write(reinterpret_cast<Byte *>(&symbol_count), sizeof(symbol_count));
+	void put_frame() {
+		if (frame_count == 0) {
+			return;
+		}
+		write_frame(frame_count);
+		frame_count = 0;
 	}
 
-	void put_plain(Symbol symbol) {
-		for (int i = 0; i < Base::SYMBOL_BIT; ++i) {
-			put_bit(get_bit(symbol, i));
+	// Store the symbols of a frame from first on raw, if enough of them are at hand to tell that coding
+	// would not shrink them, and return how many were stored, zero for none; the frame is closed at once,
+	// past the model and the put_run and put_frame of derived_type, so neither the model nor the
+	// open frame of a coder is touched, and the CPU the coder would spend on them is saved
+	Size put_stored(Symbol const * first, Symbol const * last) {
+		Size count = frame_size * BIT_PER_BYTE / Base::SYMBOL_BIT;
+		if (static_cast<Size>(last - first) < count) {
+			count = last - first;
 		}
+		if (count < Base::STORED_MIN_COUNT || !derived().is_worth_storing(first, first + count)) {
+			return 0;
+		}
+		Self::put_run(first, first + count, ~static_cast<Size>(0));
+		write_frame(static_cast<UInt32>(count) | StreamHeader::STORED_COUNT);
+		return count;
 	}
 
-	void put_bit(Bit bit) {
-		set_bit(buffer, buffer_bit++, bit);
-		if (buffer_bit == BUFFER_BIT) {
-			ostream.write(buffer, BUFFER_SIZE);
-			clear_buffer();
+	// Write the frame in the writer, with count as its symbol count
+	void write_frame(UInt32 count) {
+		writer.flush();
+		put_integer(*ostream, writer.size(), ByteSize<UInt32>::value);
+		put_integer(*ostream, count, ByteSize<UInt32>::value);
+		ostream->write(writer.data(), writer.size());
+		frame_bytes += Base::FRAME_HEADER_SIZE + writer.size();
+		writer.clear();
+	}
+
+	void put_end() {
+		put_integer(*ostream, 0, ByteSize<UInt32>::value);
+		put_integer(*ostream, 0, ByteSize<UInt32>::value);
+		if (index != nullptr) {
+			index->put(*ostream);
+		}
+		ostream->flush();
+	}
+
+	// Record the frame about to open as a sync point, with the model it starts from
+	void put_sync_point() {
+		std::basic_ostringstream<Byte> model;
+		if (symbol_count != 0 && (header.flags & StreamHeader::INDEPENDENT) == 0) {
+			derived().put_model(model);
 		}
+		index->add(frame_bytes, symbol_count, model.str());
+	}
+
+	// Independent frames all start from a fresh model, so each is a sync point for free
+	static SeekIndex * make_index(Byte flags) {
+		if ((flags & StreamHeader::INDEXED) == 0) {
+			return nullptr;
+		}
+		return new SeekIndex((flags & StreamHeader::INDEPENDENT) != 0 ? 0 : SeekIndex::INTERVAL);
+	}
+
+	void put_plain(Symbol symbol) {
+		writer.put_bits(static_cast<typename Unsigned<Symbol>::Type>(symbol), Base::SYMBOL_BIT);
+	}
+
+	void put_bit(Bit bit) {
+		writer.put_bit(bit);
+	}
+
+	// Put the low n bits of bits, least significant first
+	void put_bits(UInt64 bits, Size n) {
+		writer.put_bits(bits, n);
 	}
 
 private:
@@ -99,7 +709,7 @@ private:
 	Self & operator=(Self const &) = delete;
 };
 
-template<typename symbol_type>
+template<typename symbol_type, typename derived_type = void>
 class Decoder : public CodecBase<symbol_type> {
 private:
 	using Self = Decoder;
@@ -108,75 +718,226 @@ public:
 	using Symbol = symbol_type;
 
 	using Base = CodecBase<Symbol>;
+	using Derived = typename Conditional<IsSame<derived_type, void>::value, Self, derived_type>::Type;
 
 	using IStream = typename IO<Byte>::IStream;
 	using OStream = typename IO<Symbol>::OStream;
 
 protected:
-	static Size const BUFFER_SIZE = 256;
-	static Size const BUFFER_BITWIDTH = BUFFER_SIZE * BIT_PER_BYTE;
-
-	IStream & istream;
-	Byte buffer[BUFFER_SIZE];
-	Size buffer_bit;
-	Size buffer_used;
-	Size symbol_count;
+	IStream * istream; /* null when detached, the owner then loads the frames */
+	StreamHeader header;
+	std::vector<Byte> frame;
+	BitReader reader;
+	Size symbol_count; /* symbols left in the current frame */
+	bool stored; /* the current frame holds its symbols raw, see StreamHeader::STORED */
+	bool finished;
 
 public:
-	Decoder(IStream & is) : istream(is), buffer_bit(0), buffer_used(0), symbol_count(0) {
-		get_count();
+	Decoder(IStream & is) : istream(&is), symbol_count(0), stored(false), finished(false) {
+		get_header();
 	}
 
-	virtual ~Decoder() {
+	// Go on with a stream whose header the caller has already read
+	Decoder(IStream & is, StreamHeader const & header) : istream(&is), header(header), symbol_count(0), stored(false), finished(false) {
 		// do nothing
 	}
 
-	virtual Symbol get() {
-		Symbol symbol = get_plain();
+	// A detached decoder codes the frames given to load_frame
+	explicit Decoder(UInt32 dictionary_id = 0) : istream(nullptr), symbol_count(0), stored(false), finished(true) {
+		header = StreamHeader::of<Derived>(StreamHeader::INDEPENDENT, dictionary_id);
+	}
+
+	~Decoder() {
+		// do nothing
+	}
+
+	Symbol get() {
+		Symbol symbol;
+		get_frame_run(&symbol, 1);
 		--symbol_count;
+		check_malformed();
 		return symbol;
-	};
+	}
 
-	Self & operator>>(Symbol & symbol) {
-		symbol = get();
-		return *this;
+	// Get up to count symbols into output and return how many were got, fewer only at the end of input
+	// or at a malformed frame, which fails the stream of an attached decoder
+	Size get(Symbol * output, Size count) {
+		Size done = 0;
+		while (done < count && derived().is_good()) {
+			Size run = count - done < symbol_count ? count - done : symbol_count;
+			get_frame_run(output + done, run);
+			symbol_count -= run;
+			if (!check_malformed()) {
+				break;
+			}
+			done += run;
+		}
+		return done;
+	}
+
+	// Start over from a fresh model
+	void reset() {
+		// do nothing
+	}
+
+	// Take on a model written by the encoder for a sync point, see SeekIndex, false if the input is not one
+	bool get_model(IStream & /* istream */) {
+		return true;
 	}
 
-	virtual bool is_good() {
+	Derived & operator>>(Symbol & symbol) {
+		symbol = derived().get();
+		return derived();
+	}
+
+	// Whether another symbol can be got, reading in the next frame if needed
+	bool is_good() {
+		while (symbol_count == 0 && !finished) {
+			get_frame();
+		}
 		return symbol_count > 0;
 	}
 
-	explicit operator bool() const {
-		return is_good();
+	explicit operator bool() {
+		return derived().is_good();
+	}
+
+	// Code count symbols from a payload that outlives them, on a fresh model, or take them raw from a stored one
+	void load_frame(Byte const * begin, Byte const * end, Size count, bool is_stored = false) {
+		reader.reset(begin, end);
+		symbol_count = count;
+		stored = is_stored;
+		if (!stored) {
+			derived().start_frame();
+		}
+	}
+
+	StreamHeader const & stream_header() const {
+		return header;
+	}
+
+	// Whether the current frame turned out malformed, as one that ran out before its symbols did,
+	// so that the last of them are made up
+	bool is_malformed() const {
+		return reader.is_overrun();
+	}
+
+	// Most bytes a coded frame of count symbols can take, whatever frames came before it;
+	// a frame that claims more is malformed, and is failed before anything is read for it
+	static Size payload_bound(Size count) {
+		return Base::stored_size(count);
 	}
 
 protected:
-	void fill_buffer() {
-		istream.read(buffer, BUFFER_SIZE);
-		buffer_bit = istream.gcount() * BIT_PER_CHAR;
-		buffer_used = 0;
+	void get_header() {
+		if (!header.get(*istream) || header.symbol_bit != Base::SYMBOL_BIT) {
+			fail();
+		}
+	}
+
+	void get_frame() {
+		UInt32 payload_size, count;
+		if (!get_integer(*istream, payload_size, ByteSize<UInt32>::value) || !get_integer(*istream, count, ByteSize<UInt32>::value)) {
+			fail();
+			return;
+		}
+		if (count == 0) {
+			finished = true;
+			return;
+		}
+		stored = (header.flags & StreamHeader::STORED) != 0 && (count & StreamHeader::STORED_COUNT) != 0;
+		if (stored) {
+			count &= ~StreamHeader::STORED_COUNT;
+			if (count == 0 || payload_size != Base::stored_size(count)) {
+				fail();
+				return;
+			}
+		} else if (payload_size > Derived::payload_bound(count)) {
+			fail();
+			return;
+		}
+		if (!get_bytes(*istream, frame, payload_size)) {
+			fail();
+			return;
+		}
+		reader.reset(frame.data(), frame.data() + frame.size());
+		symbol_count = count;
+		if (!stored) {
+			derived().start_frame();
+		}
 	}
 
-	void get_count() {
-		auto pos = istream.tellg();
-		istream.seekg(-ByteSize<Size>::value, std::ios_base::end);
-		istream.read(reinterpret_cast<Byte *>(&symbol_count), ByteSize<Size>::value);
-		istream.seekg(pos);
+	// Decode count symbols of the current frame into output, raw ones past the model
+	void get_frame_run(Symbol * output, Size count) {
+		if (stored) {
+			Self::get_run(output, count);
+		} else {
+			derived().get_run(output, count);
+		}
 	}
 
-	Symbol get_plain() {
-		Symbol symbol = 0;
-		for (int i = 0; i < Base::SYMBOL_BIT; ++i) {
-			set_bit(symbol, i, get_bit());
+	// Get ready for a frame just loaded into the reader, independent frames start on a fresh model;
+	// models sent along with each frame read theirs here
+	void start_frame() {
+		if ((header.flags & StreamHeader::INDEPENDENT) != 0) {
+			derived().reset();
 		}
-		return symbol;
 	}
 
-	Bit get_bit() {
-		if (buffer_used >= buffer_bit) {
-			fill_buffer();
+	// Decode count symbols of the current frame into output, which has that many left; get keeps the counts
+	void get_run(Symbol * output, Size count) {
+		for (Size i = 0; i < count; ++i) {
+			output[i] = get_plain();
 		}
-		return ::get_bit(buffer, buffer_used++);
+	}
+
+	Derived & derived() {
+		return static_cast<Derived &>(*this);
+	}
+
+	// Fail unless the stream was coded by the model this decoder runs, from the dictionary of the given id if any
+	void check_model(UInt32 dictionary_id = 0) {
+		if (!header.is_coded_as(StreamHeader::of<Derived>(0, dictionary_id))) {
+			fail();
+		}
+	}
+
+	// Fail at a malformed frame, false if it is one; a detached decoder
+	// has no stream to fail and just drops the rest of the frame
+	bool check_malformed() {
+		if (!derived().is_malformed()) {
+			return true;
+		}
+		if (istream != nullptr) {
+			fail();
+		} else {
+			symbol_count = 0;
+		}
+		return false;
+	}
+
+	// Stop at malformed input, leaving the stream in a failed state
+	void fail() {
+		istream->setstate(std::ios_base::failbit);
+		symbol_count = 0;
+		finished = true;
+	}
+
+	Symbol get_plain() {
+		return static_cast<Symbol>(reader.get_bits(Base::SYMBOL_BIT));
+	}
+
+	Bit get_bit() {
+		return reader.get_bit();
+	}
+
+	// Look at the next n bits, reading zeros past the end of the frame
+	UInt64 peek_bits(Size n) {
+		return reader.peek_bits(n);
+	}
+
+	void skip_bits(Size n) {
+		reader.skip_bits(n);
 	}
 
 private:
@@ -184,6 +945,163 @@ private:
 	Self & operator=(Self const &) = delete;
 };
 
+// Encoder seen at run time, for callers that pick a coder as they go; each call is an indirect one
+template<typename symbol_type>
+class PolymorphicEncoder {
+private:
+	using Self = PolymorphicEncoder;
+
+public:
+	using Symbol = symbol_type;
+
+	virtual ~PolymorphicEncoder() {
+		// do nothing
+	}
+
+	virtual Self & put(Symbol symbol) = 0;
+
+	virtual Size put(Symbol const * first, Symbol const * last) = 0;
+
+	virtual void reset() = 0;
+
+	virtual void look_ahead(Symbol const * first, Symbol const * last) = 0;
+
+	virtual Size count() = 0;
+
+	Self & operator<<(Symbol symbol) {
+		return put(symbol);
+	}
+};
+
+// A PolymorphicEncoder running an encoder_type built from the given constructor arguments
+template<typename encoder_type>
+class PolymorphicEncoderAdapter : public PolymorphicEncoder<typename encoder_type::Symbol> {
+private:
+	using Self = PolymorphicEncoderAdapter;
+
+public:
+	using Symbol = typename encoder_type::Symbol;
+
+	using Base = PolymorphicEncoder<Symbol>;
+
+	using Encoder = encoder_type;
+
+private:
+	Encoder encoder;
+
+public:
+	template<typename... argument_types>
+	explicit PolymorphicEncoderAdapter(argument_types &&... arguments) : encoder(std::forward<argument_types>(arguments)...) {
+		// do nothing
+	}
+
+	Base & put(Symbol symbol) {
+		encoder.put(symbol);
+		return *this;
+	}
+
+	Size put(Symbol const * first, Symbol const * last) {
+		return encoder.put(first, last);
+	}
+
+	void reset() {
+		encoder.reset();
+	}
+
+	void look_ahead(Symbol const * first, Symbol const * last) {
+		encoder.look_ahead(first, last);
+	}
+
+	Size count() {
+		return encoder.count();
+	}
+
+	Encoder & coder() {
+		return encoder;
+	}
+
+private:
+	PolymorphicEncoderAdapter(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+};
+
+// Decoder seen at run time, see PolymorphicEncoder
+template<typename symbol_type>
+class PolymorphicDecoder {
+private:
+	using Self = PolymorphicDecoder;
+
+public:
+	using Symbol = symbol_type;
+
+	virtual ~PolymorphicDecoder() {
+		// do nothing
+	}
+
+	virtual Symbol get() = 0;
+
+	virtual Size get(Symbol * output, Size count) = 0;
+
+	virtual void reset() = 0;
+
+	virtual bool is_good() = 0;
+
+	Self & operator>>(Symbol & symbol) {
+		symbol = get();
+		return *this;
+	}
+
+	explicit operator bool() {
+		return is_good();
+	}
+};
+
+template<typename decoder_type>
+class PolymorphicDecoderAdapter : public PolymorphicDecoder<typename decoder_type::Symbol> {
+private:
+	using Self = PolymorphicDecoderAdapter;
+
+public:
+	using Symbol = typename decoder_type::Symbol;
+
+	using Base = PolymorphicDecoder<Symbol>;
+
+	using Decoder = decoder_type;
+
+private:
+	Decoder decoder;
+
+public:
+	template<typename... argument_types>
+	explicit PolymorphicDecoderAdapter(argument_types &&... arguments) : decoder(std::forward<argument_types>(arguments)...) {
+		// do nothing
+	}
+
+	Symbol get() {
+		return decoder.get();
+	}
+
+	Size get(Symbol * output, Size count) {
+		return decoder.get(output, count);
+	}
+
+	void reset() {
+		decoder.reset();
+	}
+
+	bool is_good() {
+		return decoder.is_good();
+	}
+
+	Decoder & coder() {
+		return decoder;
+	}
+
+private:
+	PolymorphicDecoderAdapter(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+};
+
 template<typename symbol_type = Byte, typename encoder_type = Encoder<symbol_type>, typename decoder_type = Decoder<symbol_type>>
 class Codec : public CodecBase<symbol_type> {
 private:
@@ -197,37 +1115,655 @@ public:
 	using Encoder = encoder_type;
 	using Decoder = decoder_type;
 
-	using ISymbolFileStream = typename IO<Symbol>::IFileStream;
-	using OSymbolFileStream = typename IO<Symbol>::OFileStream;
+	// Symbols per independently coded block in parallel mode, bigger blocks adapt better
+	static Size const BLOCK_SIZE = 1024 * 1024;
 
-	using IByteFileStream = typename IO<Byte>::IFileStream;
-	using OByteFileStream = typename IO<Byte>::OFileStream;
+	// Coders kept from one in-memory message to the next, so that a message builds nothing;
+	// args go to the constructors of both, such as a dictionary they start from
+	class Context {
+	private:
+		Encoder encoder;
+		Decoder decoder;
 
-	static void encode(typename Encoder::IStream & istream, typename Encoder::OStream & ostream) {
-		Encoder encoder(ostream);
-		for (Symbol symbol; istream.get(symbol).good();) {
-			encoder.put(symbol);
+		friend class Codec;
+
+	public:
+		template<typename... Args>
+		explicit Context(Args const & ... args) : encoder(args...), decoder(args...) {
+			// do nothing
 		}
+	};
+
+	// Contexts built ahead of time and checked out per message, safe to share between threads
+	class ContextPool {
+	private:
+		using Self = ContextPool;
+
+	public:
+		// A checked out context, going back to the pool when dropped
+		class Lease {
+		private:
+			ContextPool * pool;
+			std::unique_ptr<Context> context;
+
+		public:
+			Lease(ContextPool & pool, std::unique_ptr<Context> context) : pool(&pool), context(std::move(context)) {
+				// do nothing
+			}
+
+			Lease(Lease && other) : pool(other.pool), context(std::move(other.context)) {
+				// do nothing
+			}
+
+			~Lease() {
+				if (context != nullptr) {
+					pool->put_back(std::move(context));
+				}
+			}
+
+			Context & operator*() const {
+				return *context;
+			}
+
+			Context * operator->() const {
+				return context.get();
+			}
+		};
+
+	private:
+		std::mutex mutex;
+		std::vector<std::unique_ptr<Context>> idle;
+		std::function<Context * ()> make; /* builds a context when none is idle */
+
+	public:
+		// Contexts are built from copies of args kept by the pool, so temporaries will do
+		template<typename... Args>
+		explicit ContextPool(Size size = 0, Args const & ... args) : make([args...]() { return new Context(args...); }) {
+			idle.reserve(size);
+			for (Size i = 0; i < size; ++i) {
+				idle.emplace_back(make());
+			}
+		}
+
+		// Take an idle context, building one only if none is left
+		Lease check_out() {
+			std::unique_ptr<Context> context;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!idle.empty()) {
+					context = std::move(idle.back());
+					idle.pop_back();
+				}
+			}
+			if (context == nullptr) {
+				context.reset(make());
+			}
+			return Lease(*this, std::move(context));
+		}
+
+	private:
+		void put_back(std::unique_ptr<Context> context) {
+			std::lock_guard<std::mutex> lock(mutex);
+			idle.push_back(std::move(context));
+		}
+
+	private:
+		ContextPool(Self const &) = delete;
+		Self & operator=(Self const &) = delete;
+	};
+
+	/*
+	 * In-memory messages are the symbol count as a varint followed by a single payload,
+	 * with no stream header and no frames.
+	 */
+
+	// Most bytes a message of count symbols can take, args as the bound of the encoder takes them
+	template<typename... Args>
+	static Size bound(Size count, Args const & ... args) {
+		return Base::VARINT_SIZE + Encoder::bound(count, args...);
+	}
+
+	// Code count symbols at input into capacity bytes at output,
+	// returning the bytes written or ERROR_SIZE if they do not fit
+	static Size encode(Symbol const * input, Size count, Byte * output, Size capacity, Context & context) {
+		Byte varint[Base::VARINT_SIZE];
+		Size varint_size = put_varint(varint, count) - varint;
+		if (varint_size > capacity) {
+			return Base::ERROR_SIZE;
+		}
+		Byte * payload = std::copy(varint, varint + varint_size, output);
+		Size payload_capacity = capacity - varint_size;
+		auto & encoder = context.encoder;
+		encoder.reset();
+		encoder.open_frame(payload, payload_capacity);
+		encoder.look_ahead(input, input + count);
+		encoder.put(input, input + count);
+		Size size = encoder.take_frame(payload, payload_capacity);
+		return size == Base::ERROR_SIZE ? size : (payload - output) + size;
 	}
 
-	static void encode(char const * input_file, char const * output_file) {
-		ISymbolFileStream fin(input_file, std::ios::binary);
-		OByteFileStream fout(output_file, std::ios::binary);
-		encode(fin, fout);
+	static Size encode(Symbol const * input, Size count, Byte * output, Size capacity) {
+		Context context;
+		return encode(input, count, output, capacity, context);
+	}
+
+	// Decode the message of size bytes at input into capacity symbols at output,
+	// returning the symbols written or ERROR_SIZE if the message is malformed or does not fit
+	static Size decode(Byte const * input, Size size, Symbol * output, Size capacity, Context & context) {
+		UInt64 count;
+		Byte const * payload = get_varint(input, input + size, count);
+		if (payload == nullptr || count > capacity) {
+			return Base::ERROR_SIZE;
+		}
+		auto & decoder = context.decoder;
+		decoder.load_frame(payload, input + size, count);
+		// The reader goes on with zeros past input + size, a message cut short must not read them
+		Size done = decoder.get(output, count);
+		return done == count && !decoder.is_malformed() ? count : Base::ERROR_SIZE;
+	}
+
+	static Size decode(Byte const * input, Size size, Symbol * output, Size capacity) {
+		Context context;
+		return decode(input, size, output, capacity, context);
+	}
+
+	// flags go to the stream header, such as INDEXED
+	static void encode(Symbol const * first, Symbol const * last, typename Encoder::OStream & ostream, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		Encoder encoder(ostream, Base::FRAME_SIZE, flags);
+		encoder.look_ahead(first, last);
+		encoder.put(first, last);
+	}
+
+	static void encode(typename Encoder::IStream & istream, typename Encoder::OStream & ostream, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		Encoder encoder(ostream, Base::FRAME_SIZE, flags);
+		std::vector<Symbol> chunk(CHUNK_SIZE);
+		do {
+			istream.read(chunk.data(), chunk.size());
+			encoder.put(chunk.data(), chunk.data() + istream.gcount());
+		} while (istream.good());
+	}
+
+	// Code the input file, straight from memory if it is a regular file, otherwise in one pass as it comes,
+	// so that a pipe takes no more memory than a frame; false if a file cannot be opened;
+	// the output file is only created once the input is open
+	static bool encode(char const * input_file, char const * output_file, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		if (!is_seekable(input_file)) {
+			return encode_stream(input_file, output_file, 0, 0, flags);
+		}
+		return encode_mapped(input_file, output_file, flags);
+	}
+
+	static bool encode(char const * input_file, char const * output_file, Size thread_count, Size block_size = BLOCK_SIZE, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		if (!is_seekable(input_file)) {
+			return encode_stream(input_file, output_file, std::max<Size>(thread_count, 1), block_size, flags);
+		}
+		MappedFile input(input_file);
+		if (!input.is_open()) {
+			return false;
+		}
+		FileBuffer<Byte> output(output_file);
+		if (!output.is_open()) {
+			return false;
+		}
+		MemoryBuffer<Symbol> buffer(input.begin<Symbol>(), input.end<Symbol>());
+		typename Encoder::IStream istream(&buffer);
+		typename Encoder::OStream ostream(&output);
+		encode(istream, ostream, thread_count, block_size, flags);
+		return ostream.good();
+	}
+
+	// Code blocks of block_size symbols with fresh models on thread_count threads, at least one,
+	// the output only depends on block_size, clamped to what a frame can hold, see clamp_block_size;
+	// with the INDEXED flag, every block is a sync point; with the STORED flag, a block is stored raw if the estimate
+	// says coding would not shrink it, or if its coded form comes out no smaller, which costs nothing to undo on a fresh model
+	static void encode(typename Encoder::IStream & istream, typename Encoder::OStream & ostream, Size thread_count, Size block_size = BLOCK_SIZE, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		StreamHeader::of<Encoder>(StreamHeader::INDEPENDENT | flags).put(ostream);
+		SeekIndex index(0);
+		UInt64 frame_bytes = 0, symbol_count = 0;
+		thread_count = std::max<Size>(thread_count, 1);
+		block_size = clamp_block_size(block_size);
+		WorkerPool<Encoder> workers(thread_count);
+		std::vector<Block> blocks(thread_count * ROUND_BLOCK_NUM);
+		for (bool more = true; more; ) {
+			Size block_num = 0;
+			for (; block_num < blocks.size() && more; ++block_num) {
+				// A chunk at a time, so that a large block size takes memory only as input comes
+				auto & symbols = blocks[block_num].symbols;
+				symbols.clear();
+				for (Size size = 0; size < block_size && istream; size = symbols.size()) {
+					symbols.resize(size + (block_size - size < CHUNK_SIZE ? block_size - size : CHUNK_SIZE));
+					istream.read(symbols.data() + size, symbols.size() - size);
+					symbols.resize(size + istream.gcount());
+				}
+				more = symbols.size() == block_size;
+				if (symbols.empty()) {
+					break;
+				}
+			}
+			workers.run(block_num, [&blocks, flags](Encoder & encoder, Size index) {
+				auto & block = blocks[index];
+				Symbol const * first = block.symbols.data();
+				Symbol const * last = first + block.symbols.size();
+				bool storable = (flags & StreamHeader::STORED) != 0;
+				block.stored = storable && Encoder::is_incompressible(first, last);
+				if (!block.stored) {
+					encoder.reset();
+					encoder.look_ahead(first, last);
+					encoder.put(first, last);
+					block.count = encoder.take_frame(block.payload);
+					block.stored = storable && block.payload.size() >= Base::stored_size(block.count);
+				}
+				if (block.stored) {
+					encoder.take_stored(first, last, block.payload);
+					block.count = last - first;
+				}
+			});
+			for (Size i = 0; i < block_num; ++i) {
+				index.add(frame_bytes, symbol_count, std::basic_string<Byte>());
+				put_integer(ostream, blocks[i].payload.size(), ByteSize<UInt32>::value);
+				put_integer(ostream, blocks[i].stored ? blocks[i].count | StreamHeader::STORED_COUNT : blocks[i].count, ByteSize<UInt32>::value);
+				ostream.write(blocks[i].payload.data(), blocks[i].payload.size());
+				frame_bytes += Base::FRAME_HEADER_SIZE + blocks[i].payload.size();
+				symbol_count += blocks[i].count;
+			}
+		}
+		put_integer(ostream, 0, Base::FRAME_HEADER_SIZE);
+		if ((flags & StreamHeader::INDEXED) != 0) {
+			index.put(ostream);
+		}
+		ostream.flush();
 	}
 
 	static void decode(typename Decoder::IStream & istream, typename Decoder::OStream & ostream) {
-		for (Decoder decoder(istream); decoder.is_good();) {
-			ostream.put(decoder.get());
+		Decoder decoder(istream);
+		drain(decoder, ostream);
+	}
+
+	// Go on decoding a stream whose header the caller has already read, say to pick the codec by it
+	static void decode(typename Decoder::IStream & istream, StreamHeader const & header, typename Decoder::OStream & ostream) {
+		Decoder decoder(istream, header);
+		drain(decoder, ostream);
+	}
+
+	// Decode the input file, mapped if it is a regular file, otherwise read as it comes, so that the output
+	// of a pipe starts before its input ends; false if a file cannot be opened or the input is malformed
+	static bool decode(char const * input_file, char const * output_file) {
+		if (!is_seekable(input_file)) {
+			return decode_stream(input_file, output_file, 0);
 		}
+		MappedFile input(input_file);
+		return decode(input, output_file);
 	}
 
-	static void decode(char const * input_file, char const * output_file) {
-		IByteFileStream fin(input_file, std::ios::binary);
-		OSymbolFileStream fout(output_file, std::ios::binary);
-		decode(fin, fout);
+	static bool decode(char const * input_file, char const * output_file, Size thread_count) {
+		if (!is_seekable(input_file)) {
+			return decode_stream(input_file, output_file, std::max<Size>(thread_count, 1));
+		}
+		MappedFile input(input_file);
+		return decode(input, output_file, thread_count);
 	}
 
+	// Decode an input file the caller has already opened, say to look at its header first
+	static bool decode(MappedFile const & input, char const * output_file) {
+		if (!input.is_open()) {
+			return false;
+		}
+		FileBuffer<Symbol> output(output_file);
+		if (!output.is_open()) {
+			return false;
+		}
+		MemoryBuffer<Byte> buffer(input.data(), input.data() + input.size());
+		typename Decoder::IStream istream(&buffer);
+		typename Decoder::OStream ostream(&output);
+		decode(istream, ostream);
+		return !istream.fail() && ostream.good();
+	}
+
+	static bool decode(MappedFile const & input, char const * output_file, Size thread_count) {
+		if (!input.is_open()) {
+			return false;
+		}
+		FileBuffer<Symbol> output(output_file);
+		if (!output.is_open()) {
+			return false;
+		}
+		MemoryBuffer<Byte> buffer(input.data(), input.data() + input.size());
+		typename Decoder::IStream istream(&buffer);
+		typename Decoder::OStream ostream(&output);
+		decode(istream, ostream, thread_count);
+		return !istream.fail() && ostream.good();
+	}
+
+	// Decode the frames of a stream with independent frames on thread_count threads, at least one,
+	// other streams are decoded in sequence
+	static void decode(typename Decoder::IStream & istream, typename Decoder::OStream & ostream, Size thread_count) {
+		StreamHeader header;
+		if (!header.get(istream)) {
+			istream.setstate(std::ios_base::failbit);
+			return;
+		}
+		decode(istream, header, ostream, thread_count);
+	}
+
+	// Go on decoding a stream whose header the caller has already read on thread_count threads, see above
+	static void decode(typename Decoder::IStream & istream, StreamHeader const & header, typename Decoder::OStream & ostream, Size thread_count) {
+		if (!header.is_coded_as(StreamHeader::of<Decoder>(0))) {
+			istream.setstate(std::ios_base::failbit);
+			return;
+		}
+		if ((header.flags & StreamHeader::INDEPENDENT) == 0) {
+			Decoder decoder(istream, header);
+			drain(decoder, ostream);
+			return;
+		}
+		thread_count = std::max<Size>(thread_count, 1);
+		WorkerPool<Decoder> workers(thread_count);
+		std::vector<Block> blocks(thread_count * ROUND_BLOCK_NUM);
+		for (bool more = true; more; ) {
+			Size block_num = 0;
+			for (; block_num < blocks.size(); ++block_num) {
+				auto & block = blocks[block_num];
+				UInt32 payload_size, count;
+				if (!get_integer(istream, payload_size, ByteSize<UInt32>::value) || !get_integer(istream, count, ByteSize<UInt32>::value)) {
+					istream.setstate(std::ios_base::failbit);
+					more = false;
+					break;
+				}
+				if (count == 0) {
+					more = false;
+					break;
+				}
+				block.stored = (header.flags & StreamHeader::STORED) != 0 && (count & StreamHeader::STORED_COUNT) != 0;
+				if (block.stored) {
+					count &= ~StreamHeader::STORED_COUNT;
+					if (count == 0 || payload_size != Base::stored_size(count)) {
+						istream.setstate(std::ios_base::failbit);
+						more = false;
+						break;
+					}
+				} else if (payload_size > Decoder::payload_bound(count)) {
+					istream.setstate(std::ios_base::failbit);
+					more = false;
+					break;
+				}
+				if (!get_bytes(istream, block.payload, payload_size)) {
+					more = false;
+					break;
+				}
+				block.count = count;
+			}
+			workers.run(block_num, [&blocks](Decoder & decoder, Size index) {
+				auto & block = blocks[index];
+				decoder.load_frame(block.payload.data(), block.payload.data() + block.payload.size(), block.count, block.stored);
+				// Symbols grow a chunk at a time as they decode, a count the payload does not hold is never allocated whole
+				block.symbols.clear();
+				for (Size done = 0, size = 0; done < block.count && done == size; ) {
+					size = done + (block.count - done < CHUNK_SIZE ? block.count - done : CHUNK_SIZE);
+					block.symbols.resize(size);
+					done += decoder.get(block.symbols.data() + done, size - done);
+					block.symbols.resize(done);
+				}
+			});
+			for (Size i = 0; i < block_num; ++i) {
+				if (blocks[i].symbols.size() != blocks[i].count) {
+					// The payload ran out before its symbols did
+					istream.setstate(std::ios_base::failbit);
+					more = false;
+					break;
+				}
+				ostream.write(blocks[i].symbols.data(), blocks[i].symbols.size());
+			}
+		}
+	}
+
+	// Decode count symbols from the symbol at position on, out of a stream with a seek index, starting at the
+	// last sync point before them instead of the first frame; args go to the decoder, such as a dictionary.
+	// Returns the symbols written, fewer past the end of the stream, or ERROR_SIZE if the input is malformed
+	template<typename... Args>
+	static Size decode_range(MappedFile const & input, SeekIndex const & index, UInt64 position, Symbol * output, Size count, Args const & ... args) {
+		return decode_from(input, index, position, [output, count](Decoder & decoder) {
+			return decoder.get(output, count);
+		}, args...);
+	}
+
+	// Decode count symbols from the symbol at position on into ostream, see above, a chunk at a time,
+	// so that count may run far past the end of the stream
+	template<typename... Args>
+	static Size decode_range(MappedFile const & input, SeekIndex const & index, UInt64 position, typename Decoder::OStream & ostream, Size count, Args const & ... args) {
+		return decode_from(input, index, position, [&ostream, count](Decoder & decoder) -> Size {
+			std::vector<Symbol> chunk(count < CHUNK_SIZE ? count : CHUNK_SIZE);
+			Size done = 0;
+			while (done < count) {
+				Size size = count - done < chunk.size() ? count - done : chunk.size();
+				Size got = decoder.get(chunk.data(), size);
+				ostream.write(chunk.data(), got);
+				done += got;
+				if (got < size) {
+					break;
+				}
+			}
+			return done;
+		}, args...);
+	}
+
+	// Decode count symbols from the symbol at position on, out of a file with a seek index, see above
+	template<typename... Args>
+	static Size decode_range(char const * input_file, UInt64 position, Symbol * output, Size count, Args const & ... args) {
+		MappedFile input(input_file);
+		SeekIndex index;
+		if (!input.is_open() || !index.get(input.data(), input.data() + input.size())) {
+			return Base::ERROR_SIZE;
+		}
+		return decode_range(input, index, position, output, count, args...);
+	}
+
+protected:
+	// Code the input file mapped whole, see MappedFile, which reads in files that cannot be mapped, pipes included
+	static bool encode_mapped(char const * input_file, char const * output_file, StreamHeader::Flags flags) {
+		MappedFile input(input_file);
+		if (!input.is_open()) {
+			return false;
+		}
+		FileBuffer<Byte> output(output_file);
+		if (!output.is_open()) {
+			return false;
+		}
+		typename Encoder::OStream ostream(&output);
+		encode(input.begin<Symbol>(), input.end<Symbol>(), ostream, flags);
+		return ostream.good();
+	}
+
+private:
+	using SyncPoint = SeekIndex::SyncPoint;
+
+	static Size const ROUND_BLOCK_NUM = 4; // blocks in flight per thread
+	static Size const CHUNK_SIZE = 64 * 1024; // symbols moved per stream call
+
+	// Bring a decoder to the symbol at position, see decode_range, and return what get gets from there on
+	template<typename get_type, typename... Args>
+	static Size decode_from(MappedFile const & input, SeekIndex const & index, UInt64 position, get_type get, Args const & ... args) {
+		SyncPoint const * point = index.find(position);
+		if (!input.is_open() || point == nullptr) {
+			return index.size() == 0 && input.is_open() ? 0 : Base::ERROR_SIZE;
+		}
+		// The decoder reads the header, and whatever its model sends ahead of the frames, before the jump
+		MemoryBuffer<Byte> buffer(input.data(), input.data() + input.size());
+		typename Decoder::IStream istream(&buffer);
+		Decoder decoder(istream, args...);
+		if (!point->model.empty()) {
+			MemoryBuffer<Byte> model(point->model.data(), point->model.data() + point->model.size());
+			typename Decoder::IStream mstream(&model);
+			if (!decoder.get_model(mstream)) {
+				return Base::ERROR_SIZE;
+			}
+		}
+		if (istream.fail() || !istream.seekg(static_cast<typename Decoder::IStream::off_type>(point->offset), std::ios_base::cur)) {
+			return Base::ERROR_SIZE;
+		}
+		std::vector<Symbol> chunk(CHUNK_SIZE);
+		for (UInt64 skip = position - point->symbol; skip > 0; ) {
+			Size size = skip < chunk.size() ? static_cast<Size>(skip) : chunk.size();
+			if (decoder.get(chunk.data(), size) != size) {
+				return istream.fail() ? Base::ERROR_SIZE : 0;
+			}
+			skip -= size;
+		}
+		Size done = get(decoder);
+		return istream.fail() ? Base::ERROR_SIZE : done;
+	}
+
+	// Code an input file read front to back as it comes, on thread_count threads, in sequence for zero
+	static bool encode_stream(char const * input_file, char const * output_file, Size thread_count, Size block_size, StreamHeader::Flags flags) {
+		FileBuffer<Symbol> input(input_file, std::ios_base::in);
+		if (!input.is_open()) {
+			return false;
+		}
+		FileBuffer<Byte> output(output_file);
+		if (!output.is_open()) {
+			return false;
+		}
+		typename Encoder::IStream istream(&input);
+		typename Encoder::OStream ostream(&output);
+		if (thread_count == 0) {
+			encode(istream, ostream, flags);
+		} else {
+			encode(istream, ostream, thread_count, block_size, flags);
+		}
+		return ostream.good();
+	}
+
+	// Decode an input file read front to back as it comes, on thread_count threads, in sequence for zero
+	static bool decode_stream(char const * input_file, char const * output_file, Size thread_count) {
+		FileBuffer<Byte> input(input_file, std::ios_base::in);
+		if (!input.is_open()) {
+			return false;
+		}
+		FileBuffer<Symbol> output(output_file);
+		if (!output.is_open()) {
+			return false;
+		}
+		typename Decoder::IStream istream(&input);
+		typename Decoder::OStream ostream(&output);
+		if (thread_count == 0) {
+			decode(istream, ostream);
+		} else {
+			decode(istream, ostream, thread_count);
+		}
+		return !istream.fail() && ostream.good();
+	}
+
+	// Write out everything decoder has left, a chunk per stream call
+	static void drain(Decoder & decoder, typename Decoder::OStream & ostream) {
+		std::vector<Symbol> chunk(CHUNK_SIZE);
+		for (Size count; (count = decoder.get(chunk.data(), chunk.size())) > 0; ) {
+			ostream.write(chunk.data(), count);
+		}
+	}
+
+	// Largest block size, at least one, whose frames fit the fields of their header: a count below STORED_COUNT,
+	// and a payload of at most 32 bits however the block codes
+	static Size clamp_block_size(Size block_size) {
+		Size const MAX_PAYLOAD_SIZE = ~static_cast<UInt32>(0);
+		block_size = std::min<Size>(std::max<Size>(block_size, 1), StreamHeader::STORED_COUNT - 1);
+		for (; block_size > 1 && (Encoder::bound(block_size) > MAX_PAYLOAD_SIZE || Base::stored_size(block_size) > MAX_PAYLOAD_SIZE); block_size /= 2) {
+			// do nothing
+		}
+		return block_size;
+	}
+
+	struct Block {
+		std::vector<Symbol> symbols;
+		std::vector<Byte> payload;
+		Size count;
+		bool stored; /* the payload is the symbols raw */
+	};
+
+	// Threads kept for a whole parallel encode or decode, each with its own detached coder, so that a round
+	// of blocks costs a wake up rather than starting threads and building coders; the calling thread works too
+	template<typename coder_type>
+	class WorkerPool {
+	private:
+		using Self = WorkerPool;
+
+	private:
+		std::mutex mutex;
+		std::condition_variable started;
+		std::condition_variable finished;
+		std::function<void (coder_type &, Size)> task;
+		Size task_num;
+		std::atomic<Size> next;
+		Size round; /* rounds started */
+		Size busy; /* workers still in the round */
+		bool stopping;
+		coder_type coder; /* of the calling thread */
+		std::vector<std::thread> threads;
+
+	public:
+		explicit WorkerPool(Size thread_count) : task_num(0), next(0), round(0), busy(0), stopping(false) {
+			for (Size i = 1; i < thread_count; ++i) {
+				threads.emplace_back(&Self::serve, this);
+			}
+		}
+
+		~WorkerPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			started.notify_all();
+			for (auto & thread : threads) {
+				thread.join();
+			}
+		}
+
+		// Run task on every index below task_num and return once all are done
+		template<typename task_type>
+		void run(Size task_num, task_type task) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				this->task = task;
+				this->task_num = task_num;
+				next = 0;
+				busy = threads.size();
+				++round;
+			}
+			started.notify_all();
+			work(coder);
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [this]() { return busy == 0; });
+		}
+
+	private:
+		void serve() {
+			coder_type coder;
+			for (Size seen = 0; ; ) {
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					started.wait(lock, [this, seen]() { return stopping || round != seen; });
+					if (stopping) {
+						return;
+					}
+					seen = round;
+				}
+				work(coder);
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busy == 0) {
+					finished.notify_one();
+				}
+			}
+		}
+
+		void work(coder_type & coder) {
+			for (Size index; (index = next++) < task_num; ) {
+				task(coder, index);
+			}
+		}
+
+	private:
+		WorkerPool(Self const &) = delete;
+		Self & operator=(Self const &) = delete;
+	};
+
 };
 
 #endif
@@ -1,20 +1,107 @@
 #include "adaptive_huffman_codec.hpp"
+#include "static_huffman_codec.hpp"
 
+#include <cstdlib>
 #include <iostream>
 
 void usage() {
 	std::cerr
 		<< "Usage:\n"
-		<< "encoder src dest\n";
+		<< "decoder src dest [threads]\n"
+		<< "decoder src dest offset count\n";
+}
+
+template<typename codec_type>
+bool decode(MappedFile const & input, char const * dest, Size thread_count) {
+	if (thread_count > 0) {
+		return codec_type::decode(input, dest, thread_count);
+	} else {
+		return codec_type::decode(input, dest);
+	}
+}
+
+// Decode count symbols from offset on, through the seek index of the input
+template<typename codec_type>
+bool decode(MappedFile const & input, char const * dest, UInt64 offset, Size count) {
+	SeekIndex index;
+	if (!index.get(input.data(), input.data() + input.size())) {
+		return false;
+	}
+	FileBuffer<typename codec_type::Symbol> buffer(dest);
+	typename IO<typename codec_type::Symbol>::OStream ostream(&buffer);
+	if (!buffer.is_open()) {
+		return false;
+	}
+	Size size = codec_type::decode_range(input, index, offset, ostream, count);
+	return size != codec_type::ERROR_SIZE && ostream.flush().good();
+}
+
+// Decode the rest of a stream read as it comes, whose header has been read to pick the codec
+template<typename codec_type>
+bool decode(typename IO<Byte>::IStream & istream, StreamHeader const & header, char const * dest, Size thread_count) {
+	FileBuffer<typename codec_type::Symbol> buffer(dest);
+	typename IO<typename codec_type::Symbol>::OStream ostream(&buffer);
+	if (!buffer.is_open()) {
+		return false;
+	}
+	if (thread_count > 0) {
+		codec_type::decode(istream, header, ostream, thread_count);
+	} else {
+		codec_type::decode(istream, header, ostream);
+	}
+	return !istream.fail() && ostream.flush().good();
+}
+
+template<typename codec_type>
+bool decode(MappedFile const & input, StreamHeader const & /* header */, int argc, char ** argv) {
+	if (argc == 5) {
+		return decode<codec_type>(input, argv[2], std::strtoull(argv[3], nullptr, 10), std::strtoul(argv[4], nullptr, 10));
+	}
+	return decode<codec_type>(input, argv[2], argc == 4 ? std::strtoul(argv[3], nullptr, 10) : 0);
+}
+
+template<typename codec_type>
+bool decode(typename IO<Byte>::IStream & istream, StreamHeader const & header, int argc, char ** argv) {
+	return decode<codec_type>(istream, header, argv[2], argc == 4 ? std::strtoul(argv[3], nullptr, 10) : 0);
+}
+
+// The model byte of the stream header tells which codec wrote the input
+template<typename input_type>
+bool decode(input_type & input, StreamHeader const & header, int argc, char ** argv) {
+	switch (header.model) {
+	case StaticHuffmanCodec<char>::Decoder::MODEL:
+		return decode<StaticHuffmanCodec<char>>(input, header, argc, argv);
+	case VitterUpdate::MODEL:
+		return decode<AdaptiveHuffmanCodec<char, 0, VitterUpdate>>(input, header, argc, argv);
+	default:
+		return decode<AdaptiveHuffmanCodec<char>>(input, header, argc, argv);
+	}
 }
 
 int main(int argc, char** argv) {
-	if (argc != 3) {
+	if (argc < 3 || argc > 5) {
 		usage();
 		return -1;
 	}
 
-	AdaptiveHuffmanCodec<char>::decode(argv[1], argv[2]);
+	// Regular files are mapped, and a range needs the seek index at their end; pipes are decoded as they come
+	StreamHeader header = StreamHeader::make(BitSize<char>::value, 0, 0);
+	bool done;
+	if (argc == 5 || is_seekable(argv[1])) {
+		MappedFile input(argv[1]);
+		MemoryBuffer<Byte> buffer(input.data(), input.data() + input.size());
+		typename IO<Byte>::IStream istream(&buffer);
+		header.get(istream);
+		done = decode(input, header, argc, argv);
+	} else {
+		FileBuffer<Byte> buffer(argv[1], std::ios_base::in);
+		typename IO<Byte>::IStream istream(&buffer);
+		done = buffer.is_open() && header.get(istream) && decode(istream, header, argc, argv);
+	}
+	if (!done) {
+		std::cerr << "decoder: cannot decode " << argv[1] << " to " << argv[2] << '\n';
+		return -1;
+	}
 
 	return 0;
 }
@@ -1,20 +1,45 @@
 #include "adaptive_huffman_codec.hpp"
+#include "static_huffman_codec.hpp"
 
+#include <cstdlib>
 #include <iostream>
 
 void usage() {
 	std::cerr
 		<< "Usage:\n"
-		<< "encoder src dest\n";
+		<< "encoder src dest [threads]\n";
+}
+
+template<typename codec_type>
+bool encode(char const * src, char const * dest, Size thread_count) {
+	// Files carry a seek index, so that ranges of them decode without the frames before,
+	// and parts already compressed, such as media, are stored rather than coded again
+	StreamHeader::Flags const flags = StreamHeader::INDEXED | StreamHeader::STORED;
+	if (thread_count > 0) {
+		return codec_type::encode(src, dest, thread_count, codec_type::BLOCK_SIZE, flags);
+	} else {
+		return codec_type::encode(src, dest, flags);
+	}
 }
 
 int main(int argc, char** argv) {
-	if (argc != 3) {
+	if (argc != 3 && argc != 4) {
 		usage();
 		return -1;
 	}
 
-	AdaptiveHuffmanCodec<char>::encode(argv[1], argv[2]);
+	// Files that can be read twice are counted first and coded with a static code, pipes adaptively in one pass
+	Size thread_count = argc == 4 ? std::strtoul(argv[3], nullptr, 10) : 0;
+	bool done;
+	if (is_seekable(argv[1])) {
+		done = encode<StaticHuffmanCodec<char>>(argv[1], argv[2], thread_count);
+	} else {
+		done = encode<AdaptiveHuffmanCodec<char>>(argv[1], argv[2], thread_count);
+	}
+	if (!done) {
+		std::cerr << "encoder: cannot encode " << argv[1] << " to " << argv[2] << '\n';
+		return -1;
+	}
 
 	return 0;
 }
@@ -0,0 +1,281 @@
+#ifndef __FILE_IO_HPP__
+#define __FILE_IO_HPP__
+
+#include "type.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <ios>
+#include <streambuf>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FILE_IO_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Whether the file can be read more than once, as regular files can and pipes and terminals cannot
+inline bool is_seekable(char const * file_name) {
+#ifdef FILE_IO_HAS_MMAP
+	struct stat status;
+	return stat(file_name, &status) == 0 && S_ISREG(status.st_mode);
+#else
+	std::FILE * file = std::fopen(file_name, "rb");
+	if (file == nullptr) {
+		return false;
+	}
+	bool seekable = std::fseek(file, 0, SEEK_END) == 0;
+	std::fclose(file);
+	return seekable;
+#endif
+}
+
+// Whole input file as one range of memory, mapped where the platform allows, read in otherwise
+class MappedFile {
+private:
+	using Self = MappedFile;
+
+private:
+	Byte const * bytes;
+	Size length;
+	bool mapped;
+	bool opened;
+	std::vector<Byte> content; /* used when mapping is not possible */
+
+public:
+	explicit MappedFile(char const * file_name) : bytes(nullptr), length(0), mapped(false), opened(false) {
+		if (!map(file_name)) {
+			read(file_name);
+		}
+	}
+
+	~MappedFile() {
+#ifdef FILE_IO_HAS_MMAP
+		if (mapped) {
+			munmap(const_cast<Byte *>(bytes), length);
+		}
+#endif
+	}
+
+	bool is_open() const {
+		return opened;
+	}
+
+	Byte const * data() const {
+		return bytes;
+	}
+
+	Size size() const {
+		return length;
+	}
+
+	// The content seen as symbols, a trailing partial symbol is left out
+	template<typename symbol_type>
+	symbol_type const * begin() const {
+		return reinterpret_cast<symbol_type const *>(bytes);
+	}
+
+	template<typename symbol_type>
+	symbol_type const * end() const {
+		return begin<symbol_type>() + length / sizeof(symbol_type);
+	}
+
+private:
+	bool map(char const * file_name) {
+#ifdef FILE_IO_HAS_MMAP
+		int fd = open(file_name, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat status;
+		if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size == 0) {
+			close(fd);
+			return false;
+		}
+		void * address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (address == MAP_FAILED) {
+			return false;
+		}
+		madvise(address, status.st_size, MADV_SEQUENTIAL);
+		bytes = static_cast<Byte const *>(address);
+		length = status.st_size;
+		mapped = opened = true;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void read(char const * file_name) {
+		std::FILE * file = std::fopen(file_name, "rb");
+		if (file == nullptr) {
+			return;
+		}
+		Byte chunk[64 * 1024];
+		for (Size count; (count = std::fread(chunk, 1, sizeof(chunk), file)) > 0; ) {
+			content.insert(content.end(), chunk, chunk + count);
+		}
+		opened = std::ferror(file) == 0;
+		std::fclose(file);
+		bytes = content.data();
+		length = content.size();
+	}
+
+private:
+	MappedFile(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+};
+
+// Stream buffer handing large blocks to and from the C library, for any character type;
+// it writes the file unless opened with std::ios_base::in, then it reads it front to back, pipes included
+template<typename char_type>
+class FileBuffer : public std::basic_streambuf<char_type> {
+private:
+	using Self = FileBuffer;
+	using Base = std::basic_streambuf<char_type>;
+
+public:
+	using Char = char_type;
+	using Traits = typename Base::traits_type;
+
+	static Size const BUFFER_SIZE = 1024 * 1024; // in bytes
+
+private:
+	std::FILE * file;
+	bool reading;
+	std::vector<Char> buffer;
+
+public:
+	explicit FileBuffer(char const * file_name, std::ios_base::openmode mode = std::ios_base::out) :
+		file(std::fopen(file_name, (mode & std::ios_base::in) != 0 ? "rb" : "wb")),
+		reading((mode & std::ios_base::in) != 0),
+		buffer(BUFFER_SIZE / sizeof(Char)) {
+		if (reading) {
+			this->setg(buffer.data(), buffer.data(), buffer.data());
+		} else {
+			this->setp(buffer.data(), buffer.data() + buffer.size());
+		}
+	}
+
+	~FileBuffer() {
+		if (file != nullptr) {
+			if (!reading) {
+				sync();
+			}
+			std::fclose(file);
+		}
+	}
+
+	bool is_open() const {
+		return file != nullptr;
+	}
+
+protected:
+	typename Traits::int_type overflow(typename Traits::int_type c) {
+		if (reading || sync() != 0) {
+			return Traits::eof();
+		}
+		if (!Traits::eq_int_type(c, Traits::eof())) {
+			*this->pptr() = Traits::to_char_type(c);
+			this->pbump(1);
+		}
+		return Traits::not_eof(c);
+	}
+
+	// Large writes skip the buffer
+	std::streamsize xsputn(Char const * s, std::streamsize n) {
+		if (static_cast<Size>(n) < buffer.size()) {
+			return Base::xsputn(s, n);
+		}
+		if (reading || sync() != 0) {
+			return 0;
+		}
+		return static_cast<std::streamsize>(std::fwrite(s, sizeof(Char), n, file));
+	}
+
+	typename Traits::int_type underflow() {
+		if (file == nullptr || !reading) {
+			return Traits::eof();
+		}
+		Size count = fill();
+		this->setg(buffer.data(), buffer.data(), buffer.data() + count);
+		return count > 0 ? Traits::to_int_type(buffer[0]) : Traits::eof();
+	}
+
+	int sync() {
+		if (file == nullptr || reading) {
+			return reading ? 0 : -1;
+		}
+		Size count = this->pptr() - this->pbase();
+		bool good = std::fwrite(this->pbase(), sizeof(Char), count, file) == count;
+		this->setp(buffer.data(), buffer.data() + buffer.size());
+		return good && std::fflush(file) == 0 ? 0 : -1;
+	}
+
+private:
+	// Read into the buffer and return the characters read, zero at the end of the file; where the platform
+	// allows, a pipe gives what has arrived rather than holding on until the whole buffer is full
+	Size fill() {
+#ifdef FILE_IO_HAS_MMAP
+		Byte * bytes = reinterpret_cast<Byte *>(buffer.data());
+		Size size = buffer.size() * sizeof(Char), count = 0;
+		do {
+			ssize_t got = ::read(fileno(file), bytes + count, size - count);
+			if (got <= 0) {
+				break;
+			}
+			count += got;
+		} while (count % sizeof(Char) != 0);
+		return count / sizeof(Char);
+#else
+		return std::fread(buffer.data(), sizeof(Char), buffer.size(), file);
+#endif
+	}
+
+private:
+	FileBuffer(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+};
+
+// Input stream buffer over memory owned by someone else, reads straight from it, and seeks anywhere in it
+template<typename char_type>
+class MemoryBuffer : public std::basic_streambuf<char_type> {
+private:
+	using Self = MemoryBuffer;
+	using Base = std::basic_streambuf<char_type>;
+
+public:
+	using Char = char_type;
+	using Position = typename Base::pos_type;
+	using Offset = typename Base::off_type;
+
+	MemoryBuffer(Char const * begin, Char const * end) {
+		Char * first = const_cast<Char *>(begin);
+		this->setg(first, first, first + (end - begin));
+	}
+
+protected:
+	Position seekoff(Offset offset, std::ios_base::seekdir direction, std::ios_base::openmode which) {
+		Offset size = this->egptr() - this->eback();
+		Offset from = direction == std::ios_base::beg ? 0 : direction == std::ios_base::cur ? this->gptr() - this->eback() : size;
+		if ((which & std::ios_base::in) == 0 || offset < -from || offset > size - from) {
+			return Position(Offset(-1));
+		}
+		this->setg(this->eback(), this->eback() + (from + offset), this->egptr());
+		return Position(from + offset);
+	}
+
+	Position seekpos(Position position, std::ios_base::openmode which) {
+		return seekoff(Offset(position), std::ios_base::beg, which);
+	}
+
+private:
+	MemoryBuffer(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+};
+
+#endif // __FILE_IO_HPP__
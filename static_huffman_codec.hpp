@@ -0,0 +1,738 @@
+#ifndef __STATIC_HUFFMAN_CODEC_HPP__
+#define __STATIC_HUFFMAN_CODEC_HPP__
+
+#include "type.hpp"
+#include "bit_math.hpp"
+#include "bit_stream.hpp"
+#include "symbol_index.hpp"
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+// A canonical Huffman code for the counts of a whole message: codes of equal length are consecutive
+// in symbol order, so the lengths alone describe the code. No code is longer than MAX_CODE_LENGTH bits,
+// while the code comes out deeper the counts are halved, as in a rescale, and the code built again.
+template<typename symbol_type = Byte>
+class StaticHuffmanCode {
+private:
+	using Self = StaticHuffmanCode;
+
+public:
+	using Symbol = symbol_type;
+	using InternalSymbol = UInt64;
+
+	static Size const SYMBOL_BIT = BitSize<Symbol>::value;
+
+	static Size const MAX_CODE_LENGTH = SYMBOL_BIT < 12 ? 12 : SYMBOL_BIT; // deep enough for every symbol to have a code
+	static Size const TABLE_BIT = 11; // codes up to this long are decoded by a single look up
+
+	static_assert(MAX_CODE_LENGTH <= BitReader::MAX_PEEK_BIT, "a whole code comes from a single look at the input");
+
+	// A code as put, the bit next to the root lowest
+	struct Word {
+		UInt64 bits;
+		Size length;
+	};
+
+private:
+	using Index = UInt32;
+	using Location = SymbolIndex<Index, SYMBOL_BIT>;
+
+	struct Node {
+		Size weight;
+		Size parent;
+		Size depth;
+	};
+
+	// The symbol whose code starts with the next table_bit bits, zero length if the code is longer
+	struct Entry {
+		Symbol symbol;
+		UInt32 length;
+	};
+
+	std::vector<Symbol> symbols; /* coded symbols in code order, by length, then by symbol */
+	std::vector<Byte> lengths; /* code length of each of symbols */
+	std::vector<Word> words; /* code of each of symbols, only built for encoding */
+	Location location; /* position in symbols plus one, only kept for encoding */
+	std::vector<Entry> table; /* only built for decoding */
+	Size table_bit;
+	UInt64 table_mask;
+	Size max_length;
+	Size counts[MAX_CODE_LENGTH + 1]; /* symbols per code length */
+	UInt64 firsts[MAX_CODE_LENGTH + 1]; /* first code of each length, first bit highest */
+	Size starts[MAX_CODE_LENGTH + 1]; /* position in symbols of that first code */
+
+	// Scratch space of build, kept so that building again allocates nothing
+	std::vector<Size> weights;
+	std::vector<Index> order;
+	std::vector<Node> nodes;
+	std::vector<Symbol> scratch_symbols;
+	std::vector<Byte> scratch_lengths;
+
+public:
+	StaticHuffmanCode() {
+		clear();
+	}
+
+	// Count the symbols of [first, last) and build a code for them, it codes no other symbols
+	void build(Symbol const * first, Symbol const * last) {
+		for (Symbol symbol : symbols) {
+			location.erase(to_internal(symbol));
+		}
+		clear();
+		weights.clear();
+		for (; first != last; ++first) {
+			InternalSymbol symbol = to_internal(*first);
+			Index index = location[symbol];
+			if (index == Location::NIL) {
+				symbols.push_back(*first);
+				weights.push_back(0);
+				index = static_cast<Index>(symbols.size());
+				location.set(symbol, index);
+			}
+			++weights[index - 1];
+		}
+		Size n = symbols.size();
+		if (n == 0) {
+			return;
+		}
+
+		// Leaves by increasing weight, ties by symbol, so that both sides of a stream see one order
+		order.resize(n);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [this](Index a, Index b) {
+			return weights[a] != weights[b] ? weights[a] < weights[b] : to_internal(symbols[a]) < to_internal(symbols[b]);
+		});
+		scratch_symbols.resize(n);
+		nodes.resize(n);
+		for (Size i = 0; i < n; ++i) {
+			scratch_symbols[i] = symbols[order[i]];
+			nodes[i].weight = weights[order[i]];
+		}
+		for (; huffman(n) > MAX_CODE_LENGTH; ) {
+			for (Size i = 0; i < n; ++i) {
+				nodes[i].weight = (nodes[i].weight + 1) / 2;
+			}
+		}
+
+		// Code order, by length, then by symbol
+		scratch_lengths.resize(n);
+		for (Size i = 0; i < n; ++i) {
+			scratch_lengths[i] = static_cast<Byte>(n == 1 ? 1 : nodes[i].depth);
+		}
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [this](Index a, Index b) {
+			return scratch_lengths[a] != scratch_lengths[b] ? scratch_lengths[a] < scratch_lengths[b] : to_internal(scratch_symbols[a]) < to_internal(scratch_symbols[b]);
+		});
+		lengths.resize(n);
+		for (Size i = 0; i < n; ++i) {
+			symbols[i] = scratch_symbols[order[i]];
+			lengths[i] = scratch_lengths[order[i]];
+			location.set(to_internal(symbols[i]), static_cast<Index>(i + 1));
+		}
+
+		assign();
+		words.resize(n);
+		for (Size length = 1; length <= max_length; ++length) {
+			for (Size i = 0; i < counts[length]; ++i) {
+				words[starts[length] + i] = Word{ reverse(firsts[length] + i, length), length };
+			}
+		}
+	}
+
+	// The code of a symbol the code was built for
+	Word const & operator[](Symbol symbol) const {
+		Index index = location[to_internal(symbol)];
+		assert(index != Location::NIL);
+		return words[index - 1];
+	}
+
+	// The symbol whose code starts bits, first bit lowest, and the length of that code;
+	// bits that start no code give a zero length
+	Symbol decode(UInt64 bits, Size & length) const {
+		auto const & entry = table[bits & table_mask];
+		if (entry.length != 0) {
+			length = entry.length;
+			return entry.symbol;
+		}
+		return decode_long(bits, length);
+	}
+
+	/*
+	 * The code is sent as, for each length from 1 to MAX_CODE_LENGTH, the number of codes of that
+	 * length plus one, then their symbols in increasing order, each as the gap from the one before,
+	 * the first as the symbol plus one; every number is Elias gamma coded.
+	 */
+
+	template<typename writer_type>
+	void put(writer_type & writer) const {
+		for (Size length = 1; length <= MAX_CODE_LENGTH; ++length) {
+			put_gamma(writer, (length <= max_length ? counts[length] : 0) + 1);
+			InternalSymbol previous = ~static_cast<InternalSymbol>(0);
+			for (Size i = 0; length <= max_length && i < counts[length]; ++i) {
+				InternalSymbol symbol = to_internal(symbols[starts[length] + i]);
+				put_gamma(writer, symbol - previous);
+				previous = symbol;
+			}
+		}
+	}
+
+	// Read a code sent by put and get ready to decode with it, false if it is malformed
+	template<typename reader_type>
+	bool get(reader_type & reader) {
+		clear();
+		for (Size length = 1; length <= MAX_CODE_LENGTH; ++length) {
+			UInt64 count;
+			if (!get_gamma(reader, count)) {
+				clear();
+				return false;
+			}
+			InternalSymbol symbol = ~static_cast<InternalSymbol>(0);
+			for (UInt64 i = 1; i < count; ++i) {
+				UInt64 gap;
+				if (!get_gamma(reader, gap) || (symbol += gap) >> SYMBOL_BIT != 0) {
+					clear();
+					return false;
+				}
+				symbols.push_back(static_cast<Symbol>(symbol));
+				lengths.push_back(static_cast<Byte>(length));
+			}
+		}
+		if (!assign()) {
+			clear();
+			return false;
+		}
+		table_bit = max_length < TABLE_BIT ? max_length : TABLE_BIT;
+		table_mask = low_mask(table_bit);
+		table.assign(static_cast<Size>(1) << table_bit, Entry{ Symbol(), 0 });
+		for (Size length = 1; length <= table_bit; ++length) {
+			for (Size i = 0; i < counts[length]; ++i) {
+				Entry entry{ symbols[starts[length] + i], static_cast<UInt32>(length) };
+				for (Size j = reverse(firsts[length] + i, length); j < table.size(); j += static_cast<Size>(1) << length) {
+					table[j] = entry;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Most bits the code takes when sent
+	static Size put_bound(Size distinct) {
+		return (MAX_CODE_LENGTH + distinct) * (2 * SYMBOL_BIT + 1);
+	}
+
+private:
+	static InternalSymbol to_internal(Symbol symbol) {
+		return static_cast<typename Unsigned<Symbol>::Type>(symbol);
+	}
+
+	// The low length bits of code, in reverse order
+	static UInt64 reverse(UInt64 code, Size length) {
+		UInt64 bits = 0;
+		for (Size i = 0; i < length; ++i, code >>= 1) {
+			bits = (bits << 1) | (code & 1);
+		}
+		return bits;
+	}
+
+	// Put a positive value as its bit length less one in zeros, a one, then its bits below the top one
+	template<typename writer_type>
+	static void put_gamma(writer_type & writer, UInt64 value) {
+		assert(value != 0);
+		Size n = 0;
+		for (; (value >> n) > 1; ++n) {
+			// do nothing
+		}
+		writer.put_bits(0, n);
+		writer.put_bits(1, 1);
+		writer.put_bits(value & low_mask(n), n);
+	}
+
+	// Values of more than SYMBOL_BIT + 1 bits never appear, so a longer run of zeros is malformed
+	template<typename reader_type>
+	static bool get_gamma(reader_type & reader, UInt64 & value) {
+		Size n = 0;
+		for (; reader.get_bit() == Bit::zero; ++n) {
+			if (n == SYMBOL_BIT) {
+				return false;
+			}
+		}
+		value = (static_cast<UInt64>(1) << n) | reader.get_bits(n);
+		return true;
+	}
+
+	void clear() {
+		symbols.clear();
+		lengths.clear();
+		words.clear();
+		table.assign(1, Entry{ Symbol(), 0 });
+		table_bit = 0;
+		table_mask = 0;
+		max_length = 0;
+		for (Size length = 0; length <= MAX_CODE_LENGTH; ++length) {
+			counts[length] = firsts[length] = starts[length] = 0;
+		}
+	}
+
+	// Depths of a Huffman tree over the n leaves at the front of nodes, by increasing weight,
+	// built with two queues, leaves going first on ties to keep the tree shallow; returns the deepest
+	Size huffman(Size n) {
+		nodes.resize(2 * n - 1);
+		Size leaf = 0, internal = n;
+		for (Size k = n; k < 2 * n - 1; ++k) {
+			Size a = internal == k || (leaf < n && nodes[leaf].weight <= nodes[internal].weight) ? leaf++ : internal++;
+			Size b = internal == k || (leaf < n && nodes[leaf].weight <= nodes[internal].weight) ? leaf++ : internal++;
+			nodes[k].weight = nodes[a].weight + nodes[b].weight;
+			nodes[a].parent = nodes[b].parent = k;
+		}
+		Size deepest = 0;
+		nodes[2 * n - 2].depth = 0;
+		for (Size k = 2 * n - 2; k-- > 0; ) {
+			nodes[k].depth = nodes[nodes[k].parent].depth + 1;
+			deepest = std::max(deepest, nodes[k].depth);
+		}
+		return deepest;
+	}
+
+	// Canonical codes for lengths in code order, false unless they fit a prefix code
+	bool assign() {
+		max_length = 0;
+		for (Size i = 0; i < lengths.size(); ++i) {
+			if (i > 0 && lengths[i] < lengths[i - 1]) {
+				return false;
+			}
+			++counts[lengths[i]];
+			max_length = lengths[i];
+		}
+		UInt64 code = 0;
+		Size start = 0;
+		for (Size length = 1; length <= max_length; ++length) {
+			code = (code + counts[length - 1]) << 1;
+			firsts[length] = code;
+			starts[length] = start;
+			start += counts[length];
+			if (code + counts[length] > (static_cast<UInt64>(1) << length)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Symbol decode_long(UInt64 bits, Size & length) const {
+		UInt64 code = 0;
+		for (length = 1; length <= max_length; ++length) {
+			code = (code << 1) | ((bits >> (length - 1)) & 1);
+			if (code - firsts[length] < counts[length]) {
+				return symbols[starts[length] + (code - firsts[length])];
+			}
+		}
+		length = 0;
+		return Symbol();
+	}
+
+private:
+	StaticHuffmanCode(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class StaticHuffmanCode
+
+/*
+ * What a static coder sends ahead of the symbols is the lane count less one (LANE_BIT bits),
+ * then the code. With more than one lane, symbol i of a frame goes to lane i % lane count, and
+ * the rest of the frame, from the next whole byte, is the sizes of all lanes but the last (4),
+ * then the lanes, each padded to whole bytes. A decoder then follows as many bit cursors, whose
+ * walks do not wait on each other.
+ */
+struct StaticHuffmanLanes {
+	static Byte const MODEL = 2;
+
+	static Size const LANE_BIT = 3;
+	static Size const MAX_LANE_NUM = static_cast<Size>(1) << LANE_BIT;
+};
+
+// Codes every symbol with one code built ahead from all of them, see look_ahead;
+// frames are split into lane_num lanes, see StaticHuffmanLanes
+template<typename symbol_type = Byte, Size lane_num = 1>
+class StaticHuffmanEncoder : public Encoder<symbol_type, StaticHuffmanEncoder<symbol_type, lane_num>> {
+private:
+	using Self = StaticHuffmanEncoder;
+
+public:
+	using Symbol = symbol_type;
+
+	using Base = Encoder<Symbol, Self>;
+
+	friend Base;
+
+	static Byte const MODEL = StaticHuffmanLanes::MODEL;
+	static Size const LANE_NUM = lane_num;
+
+	static_assert(LANE_NUM >= 1 && LANE_NUM <= StaticHuffmanLanes::MAX_LANE_NUM, "lane count fits its field");
+
+private:
+	using Code = StaticHuffmanCode<Symbol>;
+
+	Code code;
+	std::unique_ptr<BitWriter[]> lanes; /* null for a single lane, which is the frame itself */
+
+public:
+	StaticHuffmanEncoder(typename Base::OStream & os, Size frame_size = Base::FRAME_SIZE, Byte flags = 0) : Base(os, frame_size, flags), lanes(make_lanes()) {
+		// do nothing
+	}
+
+	StaticHuffmanEncoder() : Base(), lanes(make_lanes()) {
+		// do nothing
+	}
+
+	~StaticHuffmanEncoder() {
+		if (Base::ostream != nullptr && Base::frame_count > 0) {
+			gather();
+		}
+	}
+
+	// Build the code from every symbol to be put: an attached encoder sends it once, right after
+	// the stream header as its size (4) and the code, a detached one at the front of the frame
+	void look_ahead(Symbol const * first, Symbol const * last) {
+		code.build(first, last);
+		if (Base::ostream == nullptr) {
+			put_code(Base::writer);
+			return;
+		}
+		BitWriter writer(0);
+		put_code(writer);
+		writer.flush();
+		put_integer(*Base::ostream, writer.size(), ByteSize<UInt32>::value);
+		Base::ostream->write(writer.data(), writer.size());
+	}
+
+	// An attached encoder knows what its code takes for the symbols, a detached one has yet to build it
+	bool is_worth_storing(Symbol const * first, Symbol const * last) {
+		if (Base::ostream == nullptr) {
+			return Base::is_incompressible(first, last);
+		}
+		Size bits = 0;
+		for (Symbol const * cursor = first; cursor != last; ++cursor) {
+			bits += code[*cursor].length;
+		}
+		Size raw_bits = (last - first) * Base::SYMBOL_BIT;
+		return bits >= raw_bits - raw_bits / Base::STORED_MARGIN;
+	}
+
+	Size take_frame(Byte * output, Size capacity) {
+		gather();
+		return Base::take_frame(output, capacity);
+	}
+
+	Size take_frame(std::vector<Byte> & payload) {
+		gather();
+		return Base::take_frame(payload);
+	}
+
+	// Most bytes a frame of count symbols can take, with its code
+	static Size bound(Size count) {
+		Size distinct = count < Base::SYMBOL_NUM ? count : Base::SYMBOL_NUM;
+		Size bits = StaticHuffmanLanes::LANE_BIT + Code::put_bound(distinct) + count * Code::MAX_CODE_LENGTH;
+		Size lanes = LANE_NUM == 1 ? 0 : (LANE_NUM - 1) * ByteSize<UInt32>::value + LANE_NUM + 1;
+		return (bits + BIT_PER_BYTE - 1) / BIT_PER_BYTE + lanes;
+	}
+
+protected:
+	Size put_run(Symbol const * first, Symbol const * last, Size byte_limit) {
+		Symbol const * cursor = first;
+		if (LANE_NUM == 1) {
+			for (; cursor != last && Base::writer.byte_count() < byte_limit; ++cursor) {
+				auto const & word = code[*cursor];
+				Base::put_bits(word.bits, word.length);
+			}
+			return cursor - first;
+		}
+		// Lanes fill evenly, so the frame size is only looked at as a round starts
+		for (Size lane = Base::frame_count % LANE_NUM; cursor != last; ++cursor) {
+			if (lane == 0 && lane_byte_count() >= byte_limit) {
+				break;
+			}
+			auto const & word = code[*cursor];
+			lanes[lane].put_bits(word.bits, word.length);
+			lane = lane + 1 < LANE_NUM ? lane + 1 : 0;
+		}
+		return cursor - first;
+	}
+
+	void put_frame() {
+		gather();
+		Base::put_frame();
+	}
+
+private:
+	static BitWriter * make_lanes() {
+		return LANE_NUM == 1 ? nullptr : new BitWriter[LANE_NUM];
+	}
+
+	template<typename writer_type>
+	void put_code(writer_type & writer) {
+		writer.put_bits(LANE_NUM - 1, StaticHuffmanLanes::LANE_BIT);
+		code.put(writer);
+	}
+
+	Size lane_byte_count() const {
+		Size count = 0;
+		for (Size i = 0; i < LANE_NUM; ++i) {
+			count += lanes[i].byte_count();
+		}
+		return count;
+	}
+
+	// Move the lanes of the open frame into it, behind its code
+	void gather() {
+		if (LANE_NUM == 1) {
+			return;
+		}
+		auto & writer = Base::writer;
+		writer.flush();
+		for (Size i = 0; i < LANE_NUM; ++i) {
+			lanes[i].flush();
+			if (i + 1 < LANE_NUM) {
+				writer.put_bits(lanes[i].size(), BitSize<UInt32>::value);
+			}
+		}
+		for (Size i = 0; i < LANE_NUM; ++i) {
+			Byte const * bytes = lanes[i].data();
+			Size size = lanes[i].size(), j = 0;
+			for (; j + ByteSize<UInt64>::value <= size; j += ByteSize<UInt64>::value) {
+				writer.put_bits(load_word(bytes + j), BitSize<UInt64>::value);
+			}
+			for (; j < size; ++j) {
+				writer.put_bits(bytes[j], BIT_PER_BYTE);
+			}
+			lanes[i].clear();
+		}
+	}
+
+private:
+	StaticHuffmanEncoder(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class StaticHuffmanEncoder
+
+// Decodes streams of any lane count, as the stream tells
+template<typename symbol_type = Byte>
+class StaticHuffmanDecoder : public Decoder<symbol_type, StaticHuffmanDecoder<symbol_type>> {
+private:
+	using Self = StaticHuffmanDecoder;
+
+public:
+	using Symbol = symbol_type;
+
+	using Base = Decoder<Symbol, Self>;
+
+	friend Base;
+
+	static Byte const MODEL = StaticHuffmanLanes::MODEL;
+
+private:
+	using Code = StaticHuffmanCode<Symbol>;
+
+	Code code;
+	Size lane_num;
+	Size lane; /* the lane of the next symbol */
+	Size round_size; /* symbols in round */
+	bool unmatched; /* bits of the current frame matched no code */
+	BitReader lanes[StaticHuffmanLanes::MAX_LANE_NUM];
+	Symbol round[StaticHuffmanLanes::MAX_LANE_NUM]; /* a symbol from each lane, decoded together */
+
+public:
+	StaticHuffmanDecoder(typename Base::IStream & is) : Base(is), lane_num(1), lane(0), round_size(0), unmatched(false) {
+		get_code();
+	}
+
+	StaticHuffmanDecoder(typename Base::IStream & is, StreamHeader const & header) : Base(is, header), lane_num(1), lane(0), round_size(0), unmatched(false) {
+		get_code();
+	}
+
+	StaticHuffmanDecoder() : Base(), lane_num(1), lane(0), round_size(0), unmatched(false) {
+		// do nothing
+	}
+
+	// Most bytes a frame of count symbols can take, with its code and as many lanes as a stream may have
+	static Size payload_bound(Size count) {
+		return StaticHuffmanEncoder<Symbol, StaticHuffmanLanes::MAX_LANE_NUM>::bound(count);
+	}
+
+	// The lanes of a frame are read apart, any of them may run out or hold bits that match no code
+	bool is_malformed() const {
+		if (Base::stored) {
+			return Base::is_malformed();
+		}
+		bool malformed = Base::is_malformed() || unmatched;
+		for (Size i = 0; lane_num > 1 && i < lane_num; ++i) {
+			malformed |= lanes[i].is_overrun();
+		}
+		return malformed;
+	}
+
+protected:
+	void get_run(Symbol * output, Size count) {
+		if (lane_num == 1) {
+			for (Size i = 0; i < count; ++i) {
+				output[i] = get_symbol(Base::reader);
+			}
+			return;
+		}
+		Size i = 0;
+		for (; i < count && lane < round_size; ++i) {
+			output[i] = round[lane++];
+		}
+		// Whole rounds go straight out, a round left part way is kept for the next run
+		for (; count - i >= lane_num; i += lane_num) {
+			for (Size j = 0; j < lane_num; ++j) {
+				output[i + j] = get_symbol(lanes[j]);
+			}
+		}
+		if (i < count) {
+			get_round(Base::symbol_count - i);
+			for (; i < count; ++i) {
+				output[i] = round[lane++];
+			}
+		}
+	}
+
+	// Independent frames bring their own code, every frame of several lanes is split
+	void start_frame() {
+		unmatched = false;
+		bool good = (Base::header.flags & StreamHeader::INDEPENDENT) == 0 || get_code(Base::reader);
+		if (good && split()) {
+			return;
+		}
+		lane_num = 1;
+		if (Base::istream != nullptr) {
+			Base::fail();
+		} else {
+			Base::symbol_count = 0;
+		}
+	}
+
+private:
+	// Read the code sent after the stream header, unless the frames bring theirs
+	void get_code() {
+		Base::check_model();
+		if (Base::finished || (Base::header.flags & StreamHeader::INDEPENDENT) != 0) {
+			return;
+		}
+		UInt32 size;
+		Size const max_size = (StaticHuffmanLanes::LANE_BIT + Code::put_bound(Base::SYMBOL_NUM) + BIT_PER_BYTE - 1) / BIT_PER_BYTE;
+		if (!get_integer(*Base::istream, size, ByteSize<UInt32>::value) || size > max_size) {
+			Base::fail();
+			return;
+		}
+		if (!get_bytes(*Base::istream, Base::frame, size)) {
+			Base::fail();
+			return;
+		}
+		Base::reader.reset(Base::frame.data(), Base::frame.data() + size);
+		if (!get_code(Base::reader)) {
+			Base::fail();
+		}
+	}
+
+	Symbol get_symbol(BitReader & reader) {
+		Size length;
+		Symbol symbol = code.decode(reader.peek_bits(Code::MAX_CODE_LENGTH), length);
+		unmatched |= length == 0;
+		reader.skip_bits(length);
+		return symbol;
+	}
+
+	// Decode the next symbol of every lane, or of as many as the frame has symbols left;
+	// the walks of one round do not wait on each other
+	void get_round(Size left) {
+		round_size = left < lane_num ? left : lane_num;
+		for (Size i = 0; i < round_size; ++i) {
+			round[i] = get_symbol(lanes[i]);
+		}
+		lane = 0;
+	}
+
+	bool get_code(BitReader & reader) {
+		lane_num = static_cast<Size>(reader.get_bits(StaticHuffmanLanes::LANE_BIT)) + 1;
+		return code.get(reader);
+	}
+
+	// Point the lanes at their parts of the frame, false if the sizes run past its end
+	bool split() {
+		lane = round_size = 0;
+		if (lane_num == 1) {
+			return true;
+		}
+		Byte const * begin = Base::reader.align();
+		Byte const * end = Base::reader.limit();
+		Size header_size = (lane_num - 1) * ByteSize<UInt32>::value;
+		if (static_cast<Size>(end - begin) < header_size) {
+			return false;
+		}
+		Byte const * cursor = begin + header_size;
+		for (Size i = 0; i < lane_num; ++i) {
+			Size size = end - cursor;
+			if (i + 1 < lane_num) {
+				UInt64 lane_size = 0;
+				for (Size j = 0; j < ByteSize<UInt32>::value; ++j) {
+					lane_size |= static_cast<UInt64>(begin[i * ByteSize<UInt32>::value + j]) << (j * BIT_PER_BYTE);
+				}
+				if (lane_size > size) {
+					return false;
+				}
+				size = lane_size;
+			}
+			lanes[i].reset(cursor, cursor + size);
+			cursor += size;
+		}
+		return true;
+	}
+
+private:
+	StaticHuffmanDecoder(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class StaticHuffmanDecoder
+
+// Two passes: the symbols are counted, then coded with a fixed canonical code sent ahead of them,
+// so coding costs a table look up per symbol; the whole input must be at hand, an input stream is
+// read in before coding, so for pipes AdaptiveHuffmanCodec fits better. Parallel streams and
+// in-memory messages send a code per block or message. More lanes let decoding overlap symbols.
+template<typename symbol_type = Byte, Size lane_num = 1>
+class StaticHuffmanCodec : public Codec<symbol_type, StaticHuffmanEncoder<symbol_type, lane_num>, StaticHuffmanDecoder<symbol_type>> {
+private:
+	using Self = StaticHuffmanCodec;
+
+public:
+	using Symbol = symbol_type;
+
+	using Encoder = StaticHuffmanEncoder<Symbol, lane_num>;
+	using Decoder = StaticHuffmanDecoder<Symbol>;
+
+	using Base = Codec<Symbol, Encoder, Decoder>;
+
+	using Base::encode;
+
+	static void encode(typename Encoder::IStream & istream, typename Encoder::OStream & ostream, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		std::vector<Symbol> symbols;
+		for (Size size = 0; istream.good(); ) {
+			symbols.resize(size + CHUNK_SIZE);
+			istream.read(symbols.data() + size, CHUNK_SIZE);
+			size += istream.gcount();
+			symbols.resize(size);
+		}
+		Base::encode(symbols.data(), symbols.data() + symbols.size(), ostream, flags);
+	}
+
+	// The code needs every symbol before the first, so the input file is read whole, pipes included
+	static bool encode(char const * input_file, char const * output_file, StreamHeader::Flags flags = StreamHeader::Flags()) {
+		return Base::encode_mapped(input_file, output_file, flags);
+	}
+
+private:
+	static Size const CHUNK_SIZE = 64 * 1024; // symbols read per stream call
+
+}; // class StaticHuffmanCodec
+
+#endif // __STATIC_HUFFMAN_CODEC_HPP__
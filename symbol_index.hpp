@@ -0,0 +1,183 @@
+#ifndef __SYMBOL_INDEX_HPP__
+#define __SYMBOL_INDEX_HPP__
+
+#include "type.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+// Maps symbols to an index, NIL (zero) standing for absent;
+// symbols are at most symbol_bit wide, plus two extra keys from (1 << symbol_bit) on
+
+// One slot per possible key, for narrow symbols
+template<typename index_type, Size symbol_bit>
+class DenseSymbolIndex {
+private:
+	using Self = DenseSymbolIndex;
+
+public:
+	using Key = UInt64;
+	using Index = index_type;
+
+	static Size const KEY_NUM = (static_cast<Size>(1) << symbol_bit) + 2;
+	static Index const NIL = 0;
+
+private:
+	Index slots[KEY_NUM];
+
+public:
+	DenseSymbolIndex() {
+		for (Size i = 0; i < KEY_NUM; ++i) {
+			slots[i] = NIL;
+		}
+	}
+
+	Index operator[](Key key) const {
+		assert(key < KEY_NUM);
+		return slots[key];
+	}
+
+	void set(Key key, Index value) {
+		assert(key < KEY_NUM);
+		slots[key] = value;
+	}
+
+	void erase(Key key) {
+		assert(key < KEY_NUM);
+		slots[key] = NIL;
+	}
+
+	void assign(Self const & other) {
+		std::copy(other.slots, other.slots + KEY_NUM, slots);
+	}
+
+private:
+	DenseSymbolIndex(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class DenseSymbolIndex
+
+// Open addressing with linear probing, sized by the keys present, for wide symbols
+template<typename index_type, Size symbol_bit>
+class SparseSymbolIndex {
+private:
+	using Self = SparseSymbolIndex;
+
+public:
+	using Key = UInt64;
+	using Index = index_type;
+
+	static Index const NIL = 0;
+	static Size const MIN_CAPACITY_BIT = 4;
+
+private:
+	struct Slot {
+		Key key;
+		Index value; /* NIL when the slot is empty */
+	};
+
+	std::vector<Slot> slots;
+	Size mask;
+	Size shift;
+	Size count;
+
+public:
+	SparseSymbolIndex() {
+		allocate(MIN_CAPACITY_BIT);
+	}
+
+	Index operator[](Key key) const {
+		for (Size i = home(key); ; i = (i + 1) & mask) {
+			if (slots[i].value == NIL || slots[i].key == key) {
+				return slots[i].value;
+			}
+		}
+	}
+
+	void set(Key key, Index value) {
+		assert(value != NIL);
+		Size i = find(key);
+		if (slots[i].value == NIL) {
+			// Keep the load at most one half
+			if ((count + 1) * 2 > slots.size()) {
+				grow();
+				i = find(key);
+			}
+			++count;
+			slots[i].key = key;
+		}
+		slots[i].value = value;
+	}
+
+	void erase(Key key) {
+		Size i = find(key);
+		if (slots[i].value == NIL) {
+			return;
+		}
+		// Shift later members of the probe run back, so no tombstones are needed
+		for (Size j = (i + 1) & mask; slots[j].value != NIL; j = (j + 1) & mask) {
+			Size k = home(slots[j].key);
+			if (((j - k) & mask) >= ((j - i) & mask)) {
+				slots[i] = slots[j];
+				i = j;
+			}
+		}
+		slots[i].value = NIL;
+		--count;
+	}
+
+	void assign(Self const & other) {
+		slots = other.slots;
+		mask = other.mask;
+		shift = other.shift;
+		count = other.count;
+	}
+
+private:
+	Size home(Key key) const {
+		return static_cast<Size>((key * 0x9E3779B97F4A7C15ULL) >> shift);
+	}
+
+	// Slot holding key, or the empty slot ending its probe run
+	Size find(Key key) const {
+		Size i = home(key);
+		for (; slots[i].value != NIL && slots[i].key != key; i = (i + 1) & mask) {
+			// do nothing
+		}
+		return i;
+	}
+
+	void allocate(Size capacity_bit) {
+		slots.assign(static_cast<Size>(1) << capacity_bit, Slot{0, NIL});
+		mask = slots.size() - 1;
+		shift = BitSize<Key>::value - capacity_bit;
+		count = 0;
+	}
+
+	void grow() {
+		std::vector<Slot> old;
+		old.swap(slots);
+		allocate(BitSize<Key>::value - shift + 1);
+		for (auto const & slot : old) {
+			if (slot.value != NIL) {
+				Size i = find(slot.key);
+				slots[i] = slot;
+				++count;
+			}
+		}
+	}
+
+private:
+	SparseSymbolIndex(Self const &) = delete;
+	Self & operator=(Self const &) = delete;
+}; // class SparseSymbolIndex
+
+// Dense for byte wide symbols, sparse beyond
+template<typename index_type, Size symbol_bit>
+using SymbolIndex = typename Conditional<
+	(symbol_bit <= BIT_PER_BYTE),
+	DenseSymbolIndex<index_type, symbol_bit>,
+	SparseSymbolIndex<index_type, symbol_bit>
+>::Type;
+
+#endif // __SYMBOL_INDEX_HPP__
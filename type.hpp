@@ -49,6 +49,22 @@ struct IntegralConstant {
 typedef IntegralConstant<bool, true> True;
 typedef IntegralConstant<bool, false> False;
 
+template<bool condition, typename true_type, typename false_type>
+struct Conditional {
+	using Type = true_type;
+};
+
+template<typename true_type, typename false_type>
+struct Conditional<false, true_type, false_type> {
+	using Type = false_type;
+};
+
+template<typename, typename>
+struct IsSame : False {};
+
+template<typename type>
+struct IsSame<type, type> : True {};
+
 template<typename>
 struct IsSigned : False {};
 
@@ -95,7 +111,7 @@ struct Unsigned {
 };
 
 template<> struct Unsigned<char> { using Type = unsigned char; };
-template<> struct Unsigned<wchar_t> { using Type = UInt16; };
+template<> struct Unsigned<wchar_t> { using Type = Conditional<sizeof(wchar_t) == sizeof(UInt16), UInt16, UInt32>::Type; };
 template<> struct Unsigned<signed char> { using Type = unsigned char; };
 template<> struct Unsigned<signed short> { using Type = unsigned short; };
 template<> struct Unsigned<signed int> { using Type = unsigned int; };